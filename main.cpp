@@ -1,9 +1,19 @@
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <cstdio>
 #include <iostream>
+#include <iterator>
 #include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <fstream>
+#include <functional>
 #include <stdlib.h>
 #include <thread>
 #include <SDL.h>
@@ -18,8 +28,18 @@
 #include "stb_image.h"
 #include "stb_image_write.h"
 #include "util/arcball_camera.h"
+#include "util/brick_cache.h"
+#include "util/camera_path.h"
+#include "util/frame_stats.h"
+#include "util/glyph_cache.h"
 #include "util/json.hpp"
+#include "util/nrrd.h"
+#include "util/phase_timer.h"
+#include "util/render_handoff.h"
+#include "util/sh_import.h"
+#include "util/sh_synth.h"
 #include "util/shader.h"
+#include "util/texture_stream.h"
 #include "util/transfer_function_widget.h"
 #include "util/util.h"
 #include <eigen3/Eigen/Dense>
@@ -51,17 +71,21 @@ const std::string display_texture_fs = R"(
 #version 330 core
 
 uniform sampler2D img;
+// Window size in pixels, frames rendered at a lower resolution are scaled up
+uniform vec2 display_size;
 
 out vec4 color;
 
 void main(void){ 
-	ivec2 uv = ivec2(gl_FragCoord.xy);
-	color = texelFetch(img, uv, 0);
+	color = texture(img, gl_FragCoord.xy / display_size);
 })";
 
 int win_width = 1280;
 int win_height = 720;
 
+// Where startup time goes, reported with -timing
+PhaseTimer startup_timer;
+
 glm::vec2 transform_mouse(glm::vec2 in)
 {
     return glm::vec2(in.x * 2.f / win_width - 1.f, 1.f - 2.f * in.y / win_height);
@@ -71,7 +95,20 @@ void run_app(const std::vector<std::string> &args, SDL_Window *window);
 
 int main(int argc, const char **argv)
 {
-    OSPError init_err = ospInit(&argc, argv);
+    // The module reports its timings as info messages, so only ask for those
+    // when they are going to be shown
+    bool timing = false;
+    bool headless = false;
+    for (int i = 1; i < argc; ++i) {
+        timing = timing || starts_with(argv[i], "-timing");
+        headless = headless || std::string(argv[i]) == "-headless";
+    }
+
+    OSPError init_err;
+    {
+        PhaseTimer::Scope phase(startup_timer, "ospInit");
+        init_err = ospInit(&argc, argv);
+    }
     if (init_err != OSP_NO_ERROR) {
         throw std::runtime_error("Failed to initialize OSPRay");
     }
@@ -88,10 +125,25 @@ int main(int argc, const char **argv)
         },
         nullptr);
     ospDeviceSetStatusCallback(
-        device, [](void *, const char *msg) { std::cout << msg; }, nullptr);
+        device,
+        [](void *, const char *msg) {
+            // [timing] phase: seconds
+            const std::string m = msg;
+            const std::string tag = "[timing] ";
+            const size_t fnd = m.find(tag);
+            const size_t sep = m.rfind(": ");
+            if (fnd != std::string::npos && sep != std::string::npos && sep > fnd) {
+                const size_t name_start = fnd + tag.size();
+                startup_timer.add(m.substr(name_start, sep - name_start),
+                                  std::stod(m.substr(sep + 2)));
+                return;
+            }
+            std::cout << msg;
+        },
+        nullptr);
 
     bool warnAsErrors = true;
-    auto logLevel = OSP_LOG_WARNING;
+    auto logLevel = timing ? OSP_LOG_INFO : OSP_LOG_WARNING;
 
     ospDeviceSetParam(device, "warnAsError", OSP_BOOL, &warnAsErrors);
     ospDeviceSetParam(device, "logLevel", OSP_INT, &logLevel);
@@ -100,7 +152,17 @@ int main(int argc, const char **argv)
     ospDeviceRelease(device);
 
     // Load our module
-    ospLoadModule("tensor_geometry");
+    {
+        PhaseTimer::Scope phase(startup_timer, "module load");
+        ospLoadModule("tensor_geometry");
+    }
+
+    if (headless) {
+        // Images go straight to files, without a window, GL context or UI
+        run_app(std::vector<std::string>(argv, argv + argc), nullptr);
+        ospShutdown();
+        return 0;
+    }
 
     if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
         std::cerr << "Failed to init SDL: " << SDL_GetError() << "\n";
@@ -160,37 +222,104 @@ int main(int argc, const char **argv)
     return 0;
 }
 
-int getSHIndex(bool strides[], int x_dim, int y_dim, int z_dim, int x, int y, int z, int sh=0) {
-    const int sh_dim = 15;
-    int x_stride = strides[0] ? x : (x_dim-x);
-    int y_stride = strides[1] ? y : (y_dim-y);
-    int z_stride = strides[2] ? z : (z_dim-z);
-    int sh_stride = strides[3] ? sh : (15-sh);
-    return z_stride*y_dim*x_dim*sh_dim + y_stride*x_dim*sh_dim + x_stride*sh_dim + sh;
+/* Positions of the glyphs of an nu x nv slice with u fastest, laid out in
+ * the x = 0 plane facing the default camera
+ */
+std::vector<glm::vec3> sliceNodes(int nu, int nv, float geometry_scale)
+{
+    std::vector<glm::vec3> positions(size_t(nu) * nv);
+    size_t index = 0;
+    for (int v = 0; v < nv; ++v)
+        for (int u = 0; u < nu; ++u)
+            positions[index++] = glm::vec3(0.f,
+                                           (float)(u - nu/2) * geometry_scale,
+                                           (float)(v - nv/2) * geometry_scale);
+    return positions;
 }
 
-std::vector<glm::vec3> latVolNodes(int x, int y, int z, bool strides[4], float geometry_scale)
+// The two axes spanning slices along axis, lower one first
+void sliceAxes(int axis, int &u, int &v)
 {
-    const int size = x*y*z;
-    std::vector<glm::vec3> positions(size);
-    int index = 0;
-    std::vector<int> starts = {0,0,0};
-    std::vector<int> ends = {x,y,z};
-    std::vector<int> inc = {1,1,1};
-    for (int i = 0; i < 3; ++i)
-        if (!strides[i]) {
-            starts[i] = ends[i];
-            ends[i] = 0;
-            inc[i] = -1;
-        }
+    u = axis == 0 ? 1 : 0;
+    v = axis == 2 ? 1 : 2;
+}
 
-    for (int i = starts[0]; i != ends[0]; i += inc[0])
-        for (int j = starts[1]; j != ends[1]; j += inc[1])
-            for (int k = starts[2]; k != ends[2]; k += inc[2])
-                positions[index++] = glm::vec3((float)(k-z/2)*geometry_scale, (float)(j-y/2)*geometry_scale, (float)(i-x/2)*geometry_scale);
+/* Positions of the glyphs of the whole volume with x fastest, centered on
+ * the origin
+ */
+std::vector<glm::vec3> volumeNodes(const int dims[3], float geometry_scale)
+{
+    std::vector<glm::vec3> positions(size_t(dims[0]) * dims[1] * dims[2]);
+    size_t index = 0;
+    for (int z = 0; z < dims[2]; ++z)
+        for (int y = 0; y < dims[1]; ++y)
+            for (int x = 0; x < dims[0]; ++x)
+                positions[index++] = glm::vec3((float)(x - dims[0]/2) * geometry_scale,
+                                               (float)(y - dims[1]/2) * geometry_scale,
+                                               (float)(z - dims[2]/2) * geometry_scale);
     return positions;
 }
 
+// Where volumeNodes puts the voxel
+glm::vec3 volumeNode(const int dims[3], const int voxel[3], float geometry_scale)
+{
+    return glm::vec3((float)(voxel[0] - dims[0]/2) * geometry_scale,
+                     (float)(voxel[1] - dims[1]/2) * geometry_scale,
+                     (float)(voxel[2] - dims[2]/2) * geometry_scale);
+}
+
+/* What a perspective camera sees: the 4 side planes and the near plane
+ * through the eye, each as an inward normal and offset. Without planes it
+ * sees everything.
+ */
+struct ViewFrustum {
+    std::vector<glm::vec4> planes;
+
+    // Whether any of the box is in view
+    bool overlaps(const glm::vec3 &lo, const glm::vec3 &hi) const
+    {
+        for (const auto &p : planes) {
+            // The box corner furthest along the plane normal
+            const glm::vec3 corner(p.x > 0.f ? hi.x : lo.x,
+                                   p.y > 0.f ? hi.y : lo.y,
+                                   p.z > 0.f ? hi.z : lo.z);
+            if (glm::dot(glm::vec3(p), corner) + p.w < 0.f)
+                return false;
+        }
+        return true;
+    }
+};
+
+ViewFrustum makeFrustum(glm::vec3 eye, glm::vec3 dir, glm::vec3 up, float fovy, float aspect)
+{
+    const glm::vec3 d = glm::normalize(dir);
+    const glm::vec3 r = glm::normalize(glm::cross(d, up));
+    const glm::vec3 u = glm::cross(r, d);
+    const float tan_y = std::tan(glm::radians(fovy) / 2.f);
+    const float tan_x = tan_y * aspect;
+    ViewFrustum frustum;
+    for (const glm::vec3 &n : {d * tan_x + r, d * tan_x - r, d * tan_y + u, d * tan_y - u, d})
+        frustum.planes.push_back(glm::vec4(n, -glm::dot(n, eye)));
+    return frustum;
+}
+
+// Slices along this axis are the whole volume
+const int volumeAxis = 3;
+
+// Voxel of the volume holding glyph i of the slice at index along axis
+size_t sliceVoxel(const int dims[3], int axis, int index, size_t i)
+{
+    if (axis == volumeAxis)
+        return i;
+    int u, v;
+    sliceAxes(axis, u, v);
+    size_t c[3];
+    c[axis] = index;
+    c[u] = i % dims[u];
+    c[v] = i / dims[u];
+    return (c[2] * dims[1] + c[1]) * dims[0] + c[0];
+}
+
 std::vector<float> makeRandomCoeffs(int size, int lMax)
 {
     int coeffCount = 15 * size;
@@ -358,30 +487,20 @@ void RealWignerYRotation(float* coeffs, float angle) {
         coeffs[i+6] = l4v[i];
 }
 
-void rotateSH(std::vector<float>& coeffs, std::vector<float>& rotatedCoeffs, std::vector<glm::vec3>& wignerAngles) {
+void rotateSH(const SHCoeffView& coeffs, std::vector<float>& rotatedCoeffs, std::vector<glm::vec3>& wignerAngles) {
     for (int i = 0; i < wignerAngles.size(); ++i) {
-        for (int sh = 0; sh < 15; ++sh) rotatedCoeffs[i*15+sh] = coeffs[i*15+sh];
+        coeffs.get(i, &rotatedCoeffs[i*15]);
         RealWignerZRotation(&rotatedCoeffs[i*15], -wignerAngles[i].x);
         RealWignerYRotation(&rotatedCoeffs[i*15], -wignerAngles[i].y);
         RealWignerZRotation(&rotatedCoeffs[i*15], -wignerAngles[i].z);
     }
 }
 
-void computeBoundRadius(std::vector<float>& coeffs, std::vector<float>& boundRadius) {
-    const float sqrt3 = sqrt(3.f);
-    const float invPi4 = 0.25 / M_PI;
-    const float lCoeffs[] = {invPi4, 5.f*invPi4, 9.f*invPi4};
-    float c2[15];
-    for (int c = 0; c < boundRadius.size(); c++) {
-        for (int i = 0; i < 15; ++i)
-            c2[i] = coeffs[c*15+i]*coeffs[c*15+i];
-        float squareSum[] = {c2[0],
-                             c2[1]+c2[2]+c2[3]+c2[4]+c2[5],
-                             c2[6]+c2[7]+c2[8]+c2[9]+c2[10]+c2[11]+c2[12]+c2[13]+c2[14]};
-
-
-        float v = sqrt3 * sqrt(lCoeffs[0]*squareSum[0] + lCoeffs[1]*squareSum[1] + lCoeffs[2]*squareSum[2]);
-        boundRadius[c] = v;
+void computeBoundRadius(const SHCoeffView& coeffs, std::vector<float>& boundRadius) {
+    float c[15];
+    for (int g = 0; g < boundRadius.size(); g++) {
+        coeffs.get(g, c);
+        boundRadius[g] = sh_bound_radius(c);
     }
 }
 
@@ -393,8 +512,11 @@ void testWigner() {
     glm::normalize(ray_dir);
     glm::vec3 glyph_center(0.4, 0.3, -0.1);
     std::vector<float> sh_coeffs = {2.74, 0.72, 0.62, 2.77, 1.65, -0.53, -0.58, 1.09, 0.28, -0.36, 0.46, 0.28, -0.06, 0.80, 1.34};
+    SHCoeffView sh_view;
+    sh_view.data = sh_coeffs.data();
+    sh_view.count = 1;
     std::vector<float> boundRadius(1);
-    computeBoundRadius(sh_coeffs, boundRadius);
+    computeBoundRadius(sh_view, boundRadius);
     std::vector<float> expectedRots = {2.7728967509317433, 1.341691288484795, 2.1260518919475215};
     std::vector<glm::vec3> positions = {glyph_center};
     std::vector<glm::vec3> wignerAngles(1);
@@ -405,11 +527,846 @@ void testWigner() {
         3.2496311, -0.37610309, 0.22094306, 0.06994055, -0.8917885, -1.55573379, 0.03138365,
         -0.94377666, -0.23810967, -0.32023285};
     std::vector<float> rotatedCoeffs(15);
-    rotateSH(sh_coeffs, rotatedCoeffs, wignerAngles);
+    rotateSH(sh_view, rotatedCoeffs, wignerAngles);
     for (int i = 0; i < 15; ++i)
         assert(abs(rotatedCoeffs[i]-expectedRotSH[i]) < 1e-5);
 }
 
+SHVolume loadSHVolume(const std::string &filename,
+                      int timestep = 0,
+                      SHBasis npy_basis = SHBasis::Descoteaux07)
+{
+    auto load_start = std::chrono::steady_clock::now();
+    SHVolume volume = map_sh_volume(filename, timestep, npy_basis);
+    const double load_time = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - load_start).count();
+    std::cout << "Loaded " << filename;
+    if (volume.header.timesteps > 1)
+        std::cout << " timestep " << timestep;
+    std::cout << " (" << volume.header.encoding << ") in "
+              << load_time << "s, peak RSS " << peak_rss_bytes() / (1024 * 1024) << "MB\n";
+    // Input coefficients are scaled down by 0.6 on read
+    volume.coeffs.scale = 0.6f;
+    return volume;
+}
+
+// Put the mesh into a model, group and instance of its own
+cpp::Instance makeInstance(cpp::Geometry &mesh)
+{
+    cpp::GeometricModel model(mesh);
+    #if 0
+    float ns = 10.0f;
+    glm::vec3 ks = glm::vec3(1.0f, 1.0f, 1.0f);
+    OSPMaterial material = ospNewMaterial("sphharm", "obj");
+    ospSetParam(material, "ks", OSP_VEC3F, &ks);
+    ospSetParam(material, "ns", OSP_FLOAT, &ns);
+    ospCommit(material);
+    model.setParam("material", material);
+    #endif
+    model.commit();
+
+    cpp::Group group;
+    group.setParam("geometry", cpp::CopiedData(model));
+    group.commit();
+
+    cpp::Instance instance(group);
+    instance.commit();
+    return instance;
+}
+
+// Glyphs per batch handed from the loader thread to the render loop
+const size_t glyphBatchSize = 16384;
+
+/* A contiguous range of glyphs of a slice with its own geometry, group and
+ * instance, so adding it to the world only builds the BVH over its glyphs.
+ */
+struct GlyphBatch {
+    std::vector<glm::vec3> positions;
+    SHCoeffView coeffs;
+    std::vector<glm::vec3> wignerAngles;
+    std::vector<float> rotatedCoeffs;
+    // Back the shared AABB data when the batch's voxels are not one range
+    // of the glyph cache
+    std::vector<glm::vec3> aabbs;
+    std::vector<uint8_t> aabbs_valid;
+    cpp::Geometry mesh;
+    cpp::Instance instance;
+};
+
+void rotateBatch(GlyphBatch &batch, glm::vec3 cam_up, glm::vec3 cam_eye)
+{
+    computeWignerAngles(cam_up, cam_eye, batch.positions, batch.wignerAngles);
+    rotateSH(batch.coeffs, batch.rotatedCoeffs, batch.wignerAngles);
+    batch.mesh.setParam("glyph.rotatedCoefficients", cpp::CopiedData(batch.rotatedCoeffs));
+}
+
+/* The glyphs of one slice through the volume, built batch by batch. The
+ * batches are appended by the loader, so read them through it.
+ */
+struct GlyphSlice {
+    int axis = 2;
+    int index = 0;
+    // Back the shared coefficient data of the batches when the slice is not
+    // a contiguous range of the volume, so they must outlive them. Read and
+    // kept coefficients of each build, a list so they never move.
+    std::list<std::vector<float>> coeff_storage;
+    // Of a bricked whole volume, the bricks paged in so far and the view
+    // they were picked for. Bricks coming into view are built on top.
+    std::vector<uint8_t> bricks_paged;
+    size_t paged_view = 0;
+    std::vector<std::shared_ptr<GlyphBatch>> batches;
+    std::atomic<size_t> glyphs_loaded{0};
+    std::atomic<size_t> glyphs_total{0};
+    std::atomic<bool> done{false};
+};
+
+/* The dataset, or one timestep of it, and how its glyphs are set up */
+struct GlyphSource {
+    // Random glyphs when empty
+    std::string filename;
+    int timestep = 0;
+    // Basis of .npy files, which don't record it
+    SHBasis npy_basis = SHBasis::Descoteaux07;
+    bool bricked = false;
+    size_t brick_budget_mb = 1024;
+    // The slice shown first is the middle one along the axis, moved by the
+    // offset. Along volumeAxis the whole volume is shown.
+    int slice_axis = 2;
+    int slice_offset = 0;
+    // Slices built ahead on each side of the shown one
+    int prebuilt_slices = 4;
+    // Box (lower xyz, upper xyz) the glyphs shown are clipped to, shared
+    // with the geometry and culled in its kernels unless clip_rebuild is set.
+    // Then glyphs outside of it are left out of the BVH instead, and moving
+    // it rebuilds the slices.
+    float *clip_box = nullptr;
+    bool clip_rebuild = false;
+    float geometry_scale = 1.f;
+    float sh_scale = 1.f;
+    float sh_0_scale = 1.f;
+    bool use_cylinder = false;
+    // Where glyph AABBs and bound radii of the file are kept across runs,
+    // nowhere if empty
+    std::string glyph_cache_dir;
+    // Only glyphs inside the mask, if any, and passing both thresholds are
+    // kept. The thresholds apply to the coefficients as rendered.
+    std::string mask_file;
+    float c0_threshold = -std::numeric_limits<float>::infinity();
+    float gfa_threshold = 0.f;
+    SHRenderMethod shRenderMethod = SHRenderMethod::Naive;
+    cpp::Camera camera;
+    glm::vec3 cam_up;
+    glm::vec3 cam_eye;
+    // A bricked whole volume is paged in as far as it is seen from here and
+    // the box it is rebuilt clipped to lets through
+    ViewFrustum view;
+};
+
+/* Reads a source on a background thread and builds the glyphs of the shown
+ * slice batch by batch, so the first glyphs can be drawn while the rest are
+ * still being read. Once it is done the slices around it are built too, each
+ * with its own groups, so moving to a neighbouring slice only swaps the
+ * instances the world references.
+ */
+class GlyphLoader {
+    // Backs the shared coefficient data of z slices, so it must outlive them
+    SHVolume volume;
+    std::unique_ptr<BrickCache> brick_cache;
+    SHCoeffView volume_coeffs;
+    // Null when caching is off or the cache could not be opened
+    std::unique_ptr<GlyphCache> glyph_cache;
+    std::vector<uint8_t> mask;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wanted_changed;
+    // Signalled when a slice is built or the thread stops
+    std::condition_variable slice_done;
+    int wanted_axis = 2;
+    // Resolved from the source once the volume is open
+    int wanted_index = -1;
+    std::map<std::pair<int, int>, std::shared_ptr<GlyphSlice>> slices;
+    // Bumped whenever there is new work for the thread
+    size_t generation = 0;
+    float clip_box[6];
+    ViewFrustum view;
+    // Bumped whenever the view moves
+    size_t view_generation = 0;
+    std::string error;
+
+    void load(GlyphSource source);
+
+    // Whether the slice is worth building or keeping for the wanted one,
+    // called with the mutex held
+    bool nearWanted(int axis, int index, int radius) const
+    {
+        return axis == wanted_axis && std::abs(index - wanted_index) <= radius;
+    }
+
+    void buildSlice(const GlyphSource &source, std::shared_ptr<GlyphSlice> slice);
+
+public:
+    // Volume dimensions, valid once ready
+    int dims[3] = {2, 1, 1};
+    std::atomic<bool> ready{false};
+    // Set when the thread has stopped, after an error or being cancelled
+    std::atomic<bool> done{false};
+    std::atomic<bool> cancel{false};
+
+    GlyphLoader(const GlyphSource &source)
+    {
+        wanted_axis = source.slice_axis;
+        view = source.view;
+        // A culled box belongs to the render thread
+        if (source.clip_box && source.clip_rebuild)
+            std::copy(source.clip_box, source.clip_box + 6, clip_box);
+        thread = std::thread([=]() { load(source); });
+    }
+
+    ~GlyphLoader()
+    {
+        stop();
+        thread.join();
+    }
+
+    // Cancel loading, done is set once the thread has noticed
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            cancel = true;
+        }
+        wanted_changed.notify_all();
+    }
+
+    // Build the slice at index along axis next, and the ones around it after
+    void showSlice(int axis, int index)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            wanted_axis = axis;
+            wanted_index = index;
+            ++generation;
+        }
+        wanted_changed.notify_all();
+    }
+
+    // Rebuild the slices with the glyphs outside the box left out, when the
+    // source clips by rebuilding
+    void rebuildClipped(const float box[6])
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::copy(box, box + 6, clip_box);
+            slices.clear();
+            ++generation;
+        }
+        wanted_changed.notify_all();
+    }
+
+    // Page in the bricks of a bricked whole volume that come into view
+    void showView(const ViewFrustum &frustum)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            view = frustum;
+            ++view_generation;
+            ++generation;
+        }
+        wanted_changed.notify_all();
+    }
+
+    // Number of slices along the axis
+    int sliceCount(int axis) const
+    {
+        return axis == volumeAxis ? 1 : dims[axis];
+    }
+
+    // The slice shown first, valid once ready
+    int firstSlice()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return wanted_index;
+    }
+
+    // Wait until the slice shown first is built, returns null if the thread
+    // stopped before that
+    std::shared_ptr<GlyphSlice> waitForFirstSlice()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        std::shared_ptr<GlyphSlice> slice;
+        slice_done.wait(lock, [&]() {
+            auto fnd = slices.find(std::make_pair(wanted_axis, wanted_index));
+            if (fnd != slices.end() && fnd->second->done)
+                slice = fnd->second;
+            return slice || done;
+        });
+        return slice;
+    }
+
+    // The slice at index along axis if it is built or being built
+    std::shared_ptr<GlyphSlice> slice(int axis, int index)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto fnd = slices.find(std::make_pair(axis, index));
+        return fnd != slices.end() ? fnd->second : nullptr;
+    }
+
+    // The batches of the slice finished after the first n
+    std::vector<std::shared_ptr<GlyphBatch>> batchesSince(const GlyphSlice &slice, size_t n)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::vector<std::shared_ptr<GlyphBatch>>(slice.batches.begin() + n,
+                                                        slice.batches.end());
+    }
+
+    // The reason loading failed, reported once
+    std::string takeError()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string e;
+        e.swap(error);
+        return e;
+    }
+};
+
+void GlyphLoader::load(GlyphSource source)
+{
+    const bool cmdline_file = !source.filename.empty();
+    try {
+        if (source.bricked) {
+            // Bricked volumes are paged in as needed
+            brick_cache.reset(
+                new BrickCache(source.filename, source.brick_budget_mb * 1024 * 1024));
+            std::copy(brick_cache->dims(), brick_cache->dims() + 3, dims);
+        } else if (cmdline_file) {
+            volume = loadSHVolume(source.filename, source.timestep, source.npy_basis);
+            startup_timer.add("header parse", volume.stats.header_seconds);
+            if (volume.stats.read_seconds > 0.0)
+                startup_timer.add("payload " + volume.stats.read_method,
+                                  volume.stats.read_seconds,
+                                  volume.stats.read_bytes);
+            if (volume.stats.transform_seconds > 0.0)
+                startup_timer.add("transform", volume.stats.transform_seconds);
+            std::copy(volume.header.dims, volume.header.dims + 3, dims);
+            volume_coeffs = volume.coeffs;
+            volume_coeffs.scale *= source.sh_scale;
+            volume_coeffs.scale_0 = source.sh_0_scale;
+        }
+        if (cmdline_file && !source.glyph_cache_dir.empty()) {
+            try {
+                GlyphCacheKey key;
+                key.dataset = source.filename;
+                GlyphCache::stat_dataset(key);
+                key.timestep = source.bricked ? 0 : source.timestep;
+                key.basis = int(source.npy_basis);
+                std::copy(dims, dims + 3, key.dims);
+                key.record_stride =
+                    source.bricked ? SHCoeffView::coeff_count : int(volume_coeffs.stride);
+                key.sh_scale = source.bricked ? 0.6f * source.sh_scale : volume_coeffs.scale;
+                key.sh_0_scale = source.sh_0_scale;
+                glyph_cache.reset(new GlyphCache(source.glyph_cache_dir, key));
+            } catch (const std::exception &e) {
+                // Only slower without it
+                std::cout << "Not caching glyphs: " << e.what() << "\n";
+            }
+        }
+        if (!source.mask_file.empty()) {
+            NrrdHeader mask_header;
+            mask = read_mask_volume(source.mask_file, mask_header);
+            if (!std::equal(dims, dims + 3, mask_header.dims)) {
+                throw std::runtime_error(source.mask_file + ": mask dims "
+                                         + std::to_string(mask_header.dims[0]) + "x"
+                                         + std::to_string(mask_header.dims[1]) + "x"
+                                         + std::to_string(mask_header.dims[2])
+                                         + " do not match the volume");
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (wanted_index < 0) {
+                const int count = sliceCount(wanted_axis);
+                wanted_index =
+                    std::max(std::min(count / 2 + source.slice_offset, count - 1), 0);
+            }
+        }
+        ready = true;
+
+        while (!cancel) {
+            std::shared_ptr<GlyphSlice> next;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                // Drop the slices that moved out of reach
+                for (auto it = slices.begin(); it != slices.end();) {
+                    if (nearWanted(it->first.first, it->first.second, source.prebuilt_slices))
+                        ++it;
+                    else
+                        it = slices.erase(it);
+                }
+                // The wanted slice first, then outwards from it
+                for (int d = 0; d <= source.prebuilt_slices && !next; ++d) {
+                    for (int index : {wanted_index + d, wanted_index - d}) {
+                        const auto key = std::make_pair(wanted_axis, index);
+                        if (index < 0 || index >= sliceCount(wanted_axis) || slices.count(key))
+                            continue;
+                        next = std::make_shared<GlyphSlice>();
+                        next->axis = wanted_axis;
+                        next->index = index;
+                        slices[key] = next;
+                        break;
+                    }
+                }
+                if (!next && brick_cache && wanted_axis == volumeAxis) {
+                    // Build the bricks a moved view brings in on top
+                    auto fnd = slices.find(std::make_pair(wanted_axis, wanted_index));
+                    if (fnd != slices.end() && fnd->second->done
+                        && fnd->second->paged_view != view_generation)
+                        next = fnd->second;
+                }
+                if (!next) {
+                    const size_t seen = generation;
+                    wanted_changed.wait(lock, [&]() { return cancel || generation != seen; });
+                    continue;
+                }
+            }
+            buildSlice(source, next);
+        }
+    } catch (const std::exception &e) {
+        std::lock_guard<std::mutex> lock(mutex);
+        error = e.what();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    slice_done.notify_all();
+}
+
+void GlyphLoader::buildSlice(const GlyphSource &source, std::shared_ptr<GlyphSlice> slice)
+{
+    auto build_start = std::chrono::steady_clock::now();
+    const bool cmdline_file = !source.filename.empty();
+    const bool whole_volume = slice->axis == volumeAxis;
+    // Rows of the slice run along u
+    int u = 0, v = 2;
+    if (!whole_volume)
+        sliceAxes(slice->axis, u, v);
+    const size_t n_glyphs =
+        whole_volume ? size_t(dims[0]) * dims[1] * dims[2] : size_t(dims[u]) * dims[v];
+    // A bricked whole volume is read a brick at a time, as far as it is seen
+    const bool paged = source.bricked && whole_volume;
+
+    float box[6];
+    ViewFrustum frustum;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::copy(clip_box, clip_box + 6, box);
+        frustum = view;
+        slice->paged_view = view_generation;
+    }
+    const bool clip = source.clip_box && source.clip_rebuild;
+    // Keep the glyph cache key in step with this
+    const float brick_scale = 0.6f * source.sh_scale;
+
+    // The bricks to page in, the ones not paged in yet that are in view and
+    // in the clip box
+    std::vector<size_t> bricks;
+    size_t n_paged = 0;
+    if (paged) {
+        // Bounds the radius of the scaled glyphs from the unscaled ones
+        const float radius_scale =
+            std::max(std::abs(brick_scale), std::abs(brick_scale * source.sh_0_scale));
+        if (slice->bricks_paged.empty())
+            slice->bricks_paged.resize(brick_cache->num_bricks());
+        for (size_t b = 0; b < brick_cache->num_bricks(); ++b) {
+            const BrickInfo &info = brick_cache->brick_info(b);
+            if (slice->bricks_paged[b])
+                continue;
+            // Bounds of the glyph centers, the clip box culls by them
+            const int last[3] = {info.hi[0] - 1, info.hi[1] - 1, info.hi[2] - 1};
+            const glm::vec3 lo = volumeNode(dims, info.lo, source.geometry_scale);
+            const glm::vec3 hi = volumeNode(dims, last, source.geometry_scale);
+            if (clip
+                && (hi.x < box[0] || hi.y < box[1] || hi.z < box[2] || lo.x > box[3]
+                    || lo.y > box[4] || lo.z > box[5]))
+                continue;
+            const glm::vec3 radius(info.max_radius * radius_scale);
+            if (!frustum.overlaps(lo - radius, hi + radius))
+                continue;
+            slice->bricks_paged[b] = 1;
+            bricks.push_back(b);
+            n_paged += info.num_voxels();
+        }
+        if (bricks.empty() && slice->done) {
+            // Nothing new came into view
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        slice->done = false;
+    }
+
+    // Backs this build's shared coefficient data
+    slice->coeff_storage.emplace_back();
+    std::vector<float> &read_coeffs = slice->coeff_storage.back();
+    slice->coeff_storage.emplace_back();
+    std::vector<float> &kept_coeffs = slice->coeff_storage.back();
+
+    SHCoeffView coeffs;
+    // The voxel of each glyph read, when paged
+    std::vector<size_t> paged_voxels;
+    if (paged) {
+        PhaseTimer::Scope phase(
+            startup_timer, "brick read", n_paged * SHCoeffView::coeff_count * sizeof(float));
+        read_coeffs.resize(n_paged * SHCoeffView::coeff_count);
+        paged_voxels.reserve(n_paged);
+        for (size_t b : bricks) {
+            const BrickInfo &info = brick_cache->brick_info(b);
+            const auto brick = brick_cache->load(b);
+            std::copy(brick->begin(),
+                      brick->end(),
+                      read_coeffs.begin() + paged_voxels.size() * SHCoeffView::coeff_count);
+            for (int z = info.lo[2]; z < info.hi[2]; ++z)
+                for (int y = info.lo[1]; y < info.hi[1]; ++y)
+                    for (int x = info.lo[0]; x < info.hi[0]; ++x)
+                        paged_voxels.push_back((size_t(z) * dims[1] + y) * dims[0] + x);
+        }
+        coeffs.data = read_coeffs.data();
+        coeffs.count = n_paged;
+        coeffs.scale = brick_scale;
+        coeffs.scale_0 = source.sh_0_scale;
+    } else if (source.bricked) {
+        int lo[3] = {0, 0, 0};
+        int hi[3] = {dims[0], dims[1], dims[2]};
+        lo[slice->axis] = slice->index;
+        hi[slice->axis] = slice->index + 1;
+        {
+            PhaseTimer::Scope phase(startup_timer,
+                                    "brick read",
+                                    n_glyphs * SHCoeffView::coeff_count * sizeof(float));
+            read_coeffs = brick_cache->read_box(lo, hi);
+        }
+        coeffs.data = read_coeffs.data();
+        coeffs.count = n_glyphs;
+        coeffs.scale = brick_scale;
+        coeffs.scale_0 = source.sh_0_scale;
+    } else if (cmdline_file && whole_volume) {
+        coeffs = volume_coeffs;
+    } else if (cmdline_file && slice->axis == 2) {
+        // A z slice is contiguous, so it is just a narrower view of the volume
+        coeffs = volume_coeffs.subview(size_t(slice->index) * n_glyphs, n_glyphs);
+    } else if (cmdline_file) {
+        std::vector<size_t> voxels(n_glyphs);
+        for (size_t i = 0; i < n_glyphs; ++i)
+            voxels[i] = sliceVoxel(dims, slice->axis, slice->index, i);
+        coeffs = volume_coeffs.gather(voxels, read_coeffs);
+    } else {
+        read_coeffs = makeRandomCoeffs(n_glyphs, 1);
+        coeffs.data = read_coeffs.data();
+        coeffs.count = n_glyphs;
+        coeffs.scale = source.sh_scale;
+        coeffs.scale_0 = source.sh_0_scale;
+    }
+    // The voxel of each glyph read
+    auto read_voxel = [&](size_t i) {
+        return paged ? paged_voxels[i] : sliceVoxel(dims, slice->axis, slice->index, i);
+    };
+    std::vector<glm::vec3> positions;
+    if (paged) {
+        positions.resize(coeffs.count);
+        for (size_t i = 0; i < coeffs.count; ++i) {
+            const size_t voxel = paged_voxels[i];
+            const int c[3] = {int(voxel % dims[0]),
+                              int(voxel / dims[0] % dims[1]),
+                              int(voxel / (size_t(dims[0]) * dims[1]))};
+            positions[i] = volumeNode(dims, c, source.geometry_scale);
+        }
+    } else {
+        positions = whole_volume ? volumeNodes(dims, source.geometry_scale)
+                                 : sliceNodes(dims[u], dims[v], source.geometry_scale);
+    }
+
+    const bool filter = clip
+        || (cmdline_file
+            && (!mask.empty() || source.c0_threshold > -1e30f || source.gfa_threshold > 0.f));
+    const size_t n_read = coeffs.count;
+    std::vector<size_t> kept;
+    if (filter) {
+        {
+            PhaseTimer::Scope phase(startup_timer, "glyph selection");
+            kept = compact_indices(coeffs.count, [&](size_t i) {
+                const glm::vec3 &p = positions[i];
+                if (clip
+                    && (p.x < box[0] || p.y < box[1] || p.z < box[2] || p.x > box[3]
+                        || p.y > box[4] || p.z > box[5]))
+                    return false;
+                if (!mask.empty() && !mask[read_voxel(i)])
+                    return false;
+                float c[SHCoeffView::coeff_count];
+                coeffs.get(i, c);
+                return c[0] >= source.c0_threshold && sh_gfa(c) >= source.gfa_threshold;
+            });
+            for (size_t i = 0; i < kept.size(); ++i)
+                positions[i] = positions[kept[i]];
+            positions.resize(kept.size());
+            coeffs = coeffs.gather(kept, kept_coeffs);
+        }
+        // Embree's BVH over user geometry takes roughly this much per
+        // primitive, OSPRay has no way to ask for the real size
+        const double bvh_bytes_per_prim = 32.0;
+        std::cout << "Kept " << kept.size() << " of " << n_read << " glyphs, BVH ~"
+                  << n_read * bvh_bytes_per_prim / (1024 * 1024) << "MB -> ~"
+                  << kept.size() * bvh_bytes_per_prim / (1024 * 1024) << "MB\n";
+    }
+    // Paged builds add to the glyphs already there
+    slice->glyphs_total += coeffs.count;
+    // The voxel of each glyph left
+    auto voxel_of = [&](size_t i) { return read_voxel(filter ? kept[i] : i); };
+
+    // Whole rows of the slice, so each batch covers a compact band of it
+    const size_t batch_size = std::max(glyphBatchSize / dims[u], size_t(1)) * dims[u];
+    for (size_t begin = 0; begin < coeffs.count; begin += batch_size) {
+        {
+            // Give up on slices no longer needed, and on prebuilding while
+            // the wanted slice waits
+            std::lock_guard<std::mutex> lock(mutex);
+            const auto key = std::make_pair(slice->axis, slice->index);
+            auto fnd = slices.find(key);
+            if (fnd == slices.end() || fnd->second != slice) {
+                // Dropped for a rebuild
+                return;
+            }
+            const bool wanted = slice->axis == wanted_axis && slice->index == wanted_index;
+            const bool wanted_waiting =
+                !wanted && !slices.count(std::make_pair(wanted_axis, wanted_index));
+            if (cancel || wanted_waiting
+                || !nearWanted(slice->axis, slice->index, source.prebuilt_slices)) {
+                slices.erase(fnd);
+                return;
+            }
+        }
+        const size_t n = std::min(batch_size, coeffs.count - begin);
+        auto batch = std::make_shared<GlyphBatch>();
+        batch->positions.assign(positions.begin() + begin, positions.begin() + begin + n);
+        batch->coeffs = coeffs.subview(begin, n);
+
+        cpp::Geometry &mesh = batch->mesh;
+        mesh = cpp::Geometry("spherical_harmonics");
+        {
+            PhaseTimer::Scope phase(startup_timer,
+                                    "CopiedData upload",
+                                    n * sizeof(glm::vec3));
+            mesh.setParam("glyph.position", cpp::CopiedData(batch->positions));
+        }
+        // Share the strided view with OSPRay, one float item per glyph, instead
+        // of copying it. The scales are applied by the geometry on read.
+        OSPData coeffData = ospNewSharedData(
+            batch->coeffs.data, OSP_FLOAT, n, batch->coeffs.stride * sizeof(float));
+        ospSetObject(mesh.handle(), "glyph.coefficients", coeffData);
+        ospRelease(coeffData);
+        mesh.setParam("glyph.shScale", batch->coeffs.scale);
+        mesh.setParam("glyph.sh0Scale", batch->coeffs.scale_0);
+        mesh.setParam("glyph.shRenderMethod", (uint)source.shRenderMethod);
+        mesh.setParam("glyph.useCylinder", source.use_cylinder);
+        if (source.clip_box && !source.clip_rebuild) {
+            OSPData clipData = ospNewSharedData(source.clip_box, OSP_FLOAT, 6);
+            ospSetObject(mesh.handle(), "glyph.clipBox", clipData);
+            ospRelease(clipData);
+        }
+        if (source.shRenderMethod == SHRenderMethod::Wigner) {
+            // Rotated for the camera at the time, the render loop
+            // catches up when the batch is published
+            batch->wignerAngles.resize(n);
+            batch->rotatedCoeffs.resize(n * 15);
+            PhaseTimer::Scope phase(startup_timer, "Wigner precompute");
+            rotateBatch(*batch, source.cam_up, source.cam_eye);
+            mesh.setParam("glyph.camera", source.camera);
+        }
+        // Where the batch's voxels sit in the glyph cache when they are
+        // one range of it, so cached values are shared with OSPRay in place
+        bool cache_range = false;
+        size_t first_voxel = 0;
+        if (glyph_cache) {
+            first_voxel = voxel_of(begin);
+            cache_range = true;
+            for (size_t i = 1; i < n && cache_range; ++i)
+                cache_range = voxel_of(begin + i) == first_voxel + i;
+        }
+        if (source.use_cylinder) {
+            std::vector<float> boundRadius(n);
+            {
+                PhaseTimer::Scope phase(startup_timer, "bound radius");
+                if (glyph_cache) {
+                    float c[SHCoeffView::coeff_count];
+                    for (size_t i = 0; i < n; ++i) {
+                        const size_t v = voxel_of(begin + i);
+                        if (!glyph_cache->radius_flags()[v]) {
+                            batch->coeffs.get(i, c);
+                            glyph_cache->radii()[v] = sh_bound_radius(c);
+                            glyph_cache->radius_flags()[v] = 1;
+                        }
+                        boundRadius[i] = glyph_cache->radii()[v];
+                    }
+                } else {
+                    computeBoundRadius(batch->coeffs, boundRadius);
+                }
+            }
+            PhaseTimer::Scope phase(startup_timer, "CopiedData upload", n * sizeof(float));
+            mesh.setParam("glyph.boundRadius", cpp::CopiedData(boundRadius));
+        } else if (glyph_cache) {
+            // The geometry searches the AABBs not flagged valid, into the
+            // cache itself or into the batch's copy of it
+            glm::vec3 *aabbs = nullptr;
+            uint8_t *aabbs_valid = nullptr;
+            if (cache_range) {
+                aabbs = reinterpret_cast<glm::vec3 *>(glyph_cache->aabbs()) + first_voxel;
+                aabbs_valid = glyph_cache->aabb_flags() + first_voxel;
+            } else {
+                batch->aabbs.resize(n);
+                batch->aabbs_valid.resize(n);
+                for (size_t i = 0; i < n; ++i) {
+                    const size_t v = voxel_of(begin + i);
+                    batch->aabbs_valid[i] = glyph_cache->aabb_flags()[v];
+                    if (batch->aabbs_valid[i])
+                        batch->aabbs[i] = reinterpret_cast<glm::vec3 *>(glyph_cache->aabbs())[v];
+                }
+                aabbs = batch->aabbs.data();
+                aabbs_valid = batch->aabbs_valid.data();
+            }
+            OSPData aabbData = ospNewSharedData(aabbs, OSP_VEC3F, n);
+            ospSetObject(mesh.handle(), "glyph.aabbs", aabbData);
+            ospRelease(aabbData);
+            OSPData validData = ospNewSharedData(aabbs_valid, OSP_UCHAR, n);
+            ospSetObject(mesh.handle(), "glyph.aabbsValid", validData);
+            ospRelease(validData);
+        }
+        {
+            PhaseTimer::Scope phase(startup_timer, "mesh.commit()");
+            mesh.commit();
+        }
+        if (glyph_cache && !source.use_cylinder) {
+            // Flagged only now that the geometry has filled them in
+            glm::vec3 *cached = reinterpret_cast<glm::vec3 *>(glyph_cache->aabbs());
+            for (size_t i = 0; i < n; ++i) {
+                const size_t v = voxel_of(begin + i);
+                if (!cache_range && !glyph_cache->aabb_flags()[v])
+                    cached[v] = batch->aabbs[i];
+                glyph_cache->aabb_flags()[v] = 1;
+            }
+            // Kept for later commits of the batch
+            std::fill(batch->aabbs_valid.begin(), batch->aabbs_valid.end(), 1);
+        }
+        {
+            // Only this batch's BVH is built here
+            PhaseTimer::Scope phase(startup_timer, "BVH build");
+            batch->instance = makeInstance(mesh);
+        }
+
+        slice->glyphs_loaded += n;
+        std::lock_guard<std::mutex> lock(mutex);
+        slice->batches.push_back(batch);
+    }
+    startup_timer.add(
+        "slice build",
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - build_start).count());
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        slice->done = true;
+    }
+    slice_done.notify_all();
+}
+
+/* What a frame shows, as far as the UI thread knew when the changes it
+ * renders were sent
+ */
+struct FrameTags {
+    bool had_glyphs = true;
+    bool had_all_glyphs = true;
+    // All glyphs are shown clipped to a moved clip box
+    bool clipped = false;
+    // Number of camera inputs the frame shows
+    size_t inputs = 0;
+
+    bool operator==(const FrameTags &b) const
+    {
+        return had_glyphs == b.had_glyphs && had_all_glyphs == b.had_all_glyphs
+            && clipped == b.clipped && inputs == b.inputs;
+    }
+    bool operator!=(const FrameTags &b) const
+    {
+        return !(*this == b);
+    }
+};
+
+/* The changes one pass of the UI loop makes to the scene, applied by the
+ * render thread between frames. Frames started after it show the tags.
+ */
+struct RenderUpdate {
+    std::vector<std::function<void()>> changes;
+    FrameTags tags;
+    // Cancel the frame in flight rather than finish it
+    bool cancel_frame = false;
+    // The camera is being moved
+    bool interacting = false;
+};
+
+/* How long the image of a view took to settle to an acceptable quality,
+ * from clearing the accumulation to OSPRay's variance estimate dropping
+ * under the quality threshold
+ */
+struct QualityReport {
+    // Counts the views measured, so a new report can be told apart
+    size_t views = 0;
+    bool denoised = false;
+    size_t samples = 0;
+    float seconds = 0.f;
+};
+
+/* A finished frame on its way from the render thread to the display */
+struct RenderedFrame {
+    // The buffer the UI thread mapped for this slot, which the frame is
+    // written into when it fits, and pixels otherwise
+    MappedPixels mapped;
+    bool in_mapped = false;
+    std::vector<uint32_t> pixels;
+    int width = 0;
+    int height = 0;
+    // Of this frame and any finished since the UI thread last took one,
+    // oldest first
+    std::vector<FrameStats> stats;
+    FrameTags tags;
+    // The latest, which may be from an earlier frame
+    QualityReport quality;
+    // Accumulation stopped with this frame
+    bool converged = false;
+};
+
+/* Encode linear RGBA like an OSP_FB_SRGBA framebuffer does, for the float
+ * framebuffers the denoiser needs
+ */
+void linearToSRGBA8(const float *src, size_t n, uint32_t *dst)
+{
+    static const std::vector<uint8_t> lut = []() {
+        std::vector<uint8_t> lut(4096);
+        for (size_t i = 0; i < lut.size(); ++i) {
+            const float c = i / float(lut.size() - 1);
+            const float srgb =
+                c <= 0.0031308f ? 12.92f * c : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+            lut[i] = uint8_t(srgb * 255.f + 0.5f);
+        }
+        return lut;
+    }();
+    for (size_t i = 0; i < n; ++i) {
+        const float *px = src + 4 * i;
+        uint32_t rgba = 0;
+        for (int c = 0; c < 3; ++c) {
+            const float v = std::max(std::min(px[c], 1.f), 0.f);
+            rgba |= uint32_t(lut[int(v * (lut.size() - 1) + 0.5f)]) << (8 * c);
+        }
+        rgba |= uint32_t(std::max(std::min(px[3], 1.f), 0.f) * 255.f + 0.5f) << 24;
+        dst[i] = rgba;
+    }
+}
+
 void run_app(const std::vector<std::string> &args, SDL_Window *window)
 {
     bool cmdline_camera = false;
@@ -418,14 +1375,60 @@ void run_app(const std::vector<std::string> &args, SDL_Window *window)
     glm::vec3 cam_up;
 
     bool cmdline_file = false;
+    bool bricked_file = false;
+    std::string make_bricks_file;
+    size_t brick_budget_mb = 1024;
     bool camera_file = false;
     bool use_cylinder = false;
+    int slice_axis = 2;
     int slice_offset = 0;
+    int prebuilt_slices = 4;
+    bool clip_rebuild = false;
     float sh_scale = 1.0;
     float sh_0_scale = 1.0;
     float geometry_scale = 1.0;
+    std::string glyph_cache_dir = GlyphCache::default_dir();
     std::string filename;
+    std::vector<std::string> series_files;
+    bool report_timing = false;
+    std::string timing_json_file;
+    // Frame rate kept while the camera moves by lowering the resolution,
+    // 0 to always render at full resolution
+    float interactive_fps = 20.f;
+    // Render straight to image files instead of a window
+    bool headless = false;
+    int headless_width = 1280;
+    int headless_height = 720;
+    // Accumulated until either runs out, a budget of 0 seconds has no limit
+    int headless_samples = 64;
+    float headless_budget = 0.f;
+    std::string headless_cameras;
+    std::string headless_output = "render.png";
+    // Camera path written when recording with R stops, and one to replay
+    // as a benchmark at a fixed number of frames between keyframes
+    std::string record_path_file = "camera_path.txt";
+    std::string replay_path_file;
+    int replay_frames = 30;
+    std::string replay_csv_file = "replay_timing.csv";
+    // Run the denoiser on every frame, guided by the albedo and normals
+    bool denoise = false;
+    // Variance estimate at which the image of a view counts as settled,
+    // above the convergence threshold so views settle before they converge
+    float quality_threshold = 0.02f;
+    // Accumulation stops once OSPRay's variance estimate is below the
+    // threshold or the sample count is reached, until the view changes
+    float variance_threshold = 0.005f;
+    int max_samples = 256;
+    SHBasis npy_basis = SHBasis::Descoteaux07;
+    std::string mask_file;
+    float c0_threshold = -std::numeric_limits<float>::infinity();
+    float gfa_threshold = 0.f;
+    std::string synthetic_file;
+    SyntheticSHParams synthetic;
+#ifndef NDEBUG
+    // Only asserts, so skip it in release builds
     testWigner();
+#endif
     glm::mat4 file_cam;
 
     for (size_t i = 1; i < args.size(); ++i) {
@@ -457,87 +1460,137 @@ void run_app(const std::vector<std::string> &args, SDL_Window *window)
             cmdline_file = true;
             filename = args[++i];
         }
+        if (args[i] == "-time_series") {
+            // -time_series t0.nrrd t1.nrrd ...
+            while (i + 1 < args.size() && args[i + 1][0] != '-')
+                series_files.push_back(args[++i]);
+            cmdline_file = !series_files.empty();
+            if (cmdline_file)
+                filename = series_files[0];
+        }
+        if (args[i] == "-bricked") {
+            cmdline_file = true;
+            bricked_file = true;
+            filename = args[++i];
+        }
+        if (args[i] == "-synthetic") {
+            // -synthetic x y z out.nrrd
+            for (int d = 0; d < 3; ++d)
+                synthetic.dims[d] = std::stoi(args[++i]);
+            synthetic_file = args[++i];
+        }
+        if (args[i] == "-seed")
+            synthetic.seed = std::stoull(args[++i]);
+        if (args[i] == "-make_bricks")
+            make_bricks_file = args[++i];
+        if (args[i] == "-brick_budget")
+            brick_budget_mb = std::stoul(args[++i]);
+        if (args[i] == "-glyph_cache_dir")
+            glyph_cache_dir = args[++i];
+        if (args[i] == "-no_glyph_cache")
+            glyph_cache_dir.clear();
+        if (args[i] == "-mask")
+            mask_file = args[++i];
+        if (args[i] == "-c0_threshold")
+            c0_threshold = std::stof(args[++i]);
+        if (args[i] == "-gfa_threshold")
+            gfa_threshold = std::stof(args[++i]);
         if (args[i] == "-use_cylinder")
             use_cylinder = true;
+        if (args[i] == "-slice_axis") {
+            // x, y or z
+            ++i;
+            slice_axis = args[i] == "x" ? 0 : args[i] == "y" ? 1 : 2;
+        }
         if (args[i] == "-slice_offset")
             slice_offset = std::stoi(args[++i]);
+        if (args[i] == "-prebuilt_slices")
+            prebuilt_slices = std::max(std::stoi(args[++i]), 0);
+        if (args[i] == "-full_volume")
+            slice_axis = volumeAxis;
+        if (args[i] == "-clip_rebuild")
+            clip_rebuild = true;
         if (args[i] == "-sh_scale")
             sh_scale = std::stof(args[++i]);
         if (args[i] == "-sh_0_scale")
             sh_0_scale = std::stof(args[++i]);
         if (args[i] == "-geometry_scale")
             geometry_scale = std::stof(args[++i]);
+        if (args[i] == "-sh_basis") {
+            // Of .npy files: descoteaux07 (DIPY's default) or tournier07
+            ++i;
+            if (args[i] == "tournier07")
+                npy_basis = SHBasis::Tournier07;
+            else if (args[i] == "descoteaux07")
+                npy_basis = SHBasis::Descoteaux07;
+            else
+                std::cerr << "Unknown SH basis '" << args[i] << "', using descoteaux07\n";
+        }
+        if (args[i] == "-timing")
+            report_timing = true;
+        if (args[i] == "-interactive_fps")
+            interactive_fps = std::stof(args[++i]);
+        if (args[i] == "-headless")
+            headless = true;
+        if (args[i] == "-size") {
+            headless_width = std::stoi(args[++i]);
+            headless_height = std::stoi(args[++i]);
+        }
+        if (args[i] == "-spp")
+            headless_samples = std::stoi(args[++i]);
+        if (args[i] == "-time_budget")
+            headless_budget = std::stof(args[++i]);
+        if (args[i] == "-camera_list")
+            headless_cameras = args[++i];
+        if (args[i] == "-output")
+            headless_output = args[++i];
+        if (args[i] == "-record_path")
+            record_path_file = args[++i];
+        if (args[i] == "-replay_path")
+            replay_path_file = args[++i];
+        if (args[i] == "-replay_frames")
+            replay_frames = std::max(std::stoi(args[++i]), 1);
+        if (args[i] == "-replay_csv")
+            replay_csv_file = args[++i];
+        if (args[i] == "-denoise")
+            denoise = true;
+        if (args[i] == "-quality_threshold")
+            quality_threshold = std::stof(args[++i]);
+        if (args[i] == "-variance_threshold")
+            variance_threshold = std::stof(args[++i]);
+        if (args[i] == "-max_samples")
+            max_samples = std::max(std::stoi(args[++i]), 1);
+        if (args[i] == "-timing_json") {
+            report_timing = true;
+            timing_json_file = args[++i];
+        }
+    }
+
+    if (!synthetic_file.empty() && !cmdline_file) {
+        const size_t n_glyphs =
+            size_t(synthetic.dims[0]) * synthetic.dims[1] * synthetic.dims[2];
+        const size_t bytes = n_glyphs * SHCoeffView::coeff_count * sizeof(float);
+        auto start = std::chrono::steady_clock::now();
+        {
+            PhaseTimer::Scope scope(startup_timer, "synthetic volume", bytes);
+            write_synthetic_sh_volume(synthetic_file, synthetic);
+        }
+        const double seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Generated " << n_glyphs << " synthetic glyphs in " << seconds << "s ("
+                  << n_glyphs / seconds * 1e-6 << "M glyphs/s, "
+                  << bytes / (1024.0 * 1024.0) / seconds << "MB/s) to " << synthetic_file
+                  << "\n";
+        cmdline_file = true;
+        filename = synthetic_file;
     }
 
-    int x, y, z, sh;
-    bool strides[] = {true, true, true, true};
-    int stride_order[] = {0, 0, 0, 0};
-
-    std::vector<float> coeffs;
-    if (cmdline_file) {
-        std::string myline;
-        std::ifstream myfile(filename);
-        std::cout << myfile.tellg() << "\n";
-        for (int i = 0; i < 75 && myfile.good(); ++i) {
-            std::getline(myfile, myline);
-            if (myline.find("dim") != std::string::npos) {
-                std::string dims = myline.substr(5);
-                int firstDelim = dims.find(",");
-                x = std::stof(dims.substr(0, firstDelim));
-                int secondDelim = dims.find(",", firstDelim+1);
-                y = std::stof(dims.substr(firstDelim+1, dims.find(",")));
-                int thirdDelim = dims.find(",", secondDelim+1);
-                z = std::stof(dims.substr(secondDelim+1, dims.find(",")));
-                int fourthDelim = dims.find(",", thirdDelim+1);
-                sh = std::stof(dims.substr(thirdDelim+1, dims.find(",")));
-            }
-            if (myline.find("layout") != std::string::npos) {
-                std::string layout = myline.substr(8);
-                int firstDelim = layout.find(",");
-                int secondDelim = layout.find(",", firstDelim+1);
-                int thirdDelim = layout.find(",", secondDelim+1);
-                strides[0] = layout[0] == '+';
-                strides[1] = layout[firstDelim+1] == '+';
-                strides[2] = layout[secondDelim+1] == '+';
-                strides[3] = layout[thirdDelim+1] == '+';
-                stride_order[0] = std::stof(layout.substr(1, firstDelim));
-                stride_order[1] = std::stof(layout.substr(firstDelim+2, 1));
-                stride_order[2] = std::stof(layout.substr(secondDelim+2, 1));
-                stride_order[3] = std::stof(layout.substr(thirdDelim+2, 1));
-            }
-            if (myline.find("END") != std::string::npos)
-                break;
-        }
-    int dims[] = {x,y,z,sh};
-    int stride_size[] = {0, 0, 0, 0};
-    stride_size[3] = 1;
-    int last_stride_size = sh;
-    int last_stride_index = 3;
-    for (int o = 1; o < 4; ++o)
-        for(int s = 0; s < 3; ++s)
-            if (stride_order[s] == o){
-                stride_size[s] = last_stride_size;
-                last_stride_size *= dims[s];
-                break;
-            }
-
-
-        coeffs.resize(x*y*z*15);
-        float f;
-        float max = 0;
-        std::ifstream bin(filename);
-        int bin_begin = myfile.tellg()+9; // skip EOL char
-        bin.seekg(bin_begin);
-        int in_index = 0;
-        for (int i = 0; i < x*y*z; ++i) {
-            for (int s = 0; s < 15; ++s) {
-                bin.read(reinterpret_cast<char*>(&f), sizeof(float));
-                coeffs[i*15+s] = f*0.6;
-            }
-            bin.seekg(bin.tellg()+(sh-15)*sizeof(float));
-        }
-        int left = 0;
-        while(bin.read(reinterpret_cast<char*>(&f), sizeof(float))) left++;
+    if (cmdline_file && !bricked_file && !make_bricks_file.empty()) {
+        // Mapped as stored, the bricks are read straight from the payload
+        SHVolume volume = map_sh_volume(filename, 0, npy_basis, false);
+        write_bricked_volume(volume, make_bricks_file);
+        std::cout << "Wrote bricked volume to " << make_bricks_file << "\n";
+        return;
     }
 
     const glm::vec3 world_center(0.f);
@@ -569,17 +1622,32 @@ void run_app(const std::vector<std::string> &args, SDL_Window *window)
     renderer.setParam("backgroundColor", glm::vec4(0.f, 0.f, 0.f, 1.f));
     renderer.commit();
 
+    // The denoiser is a module of its own, only there when OSPRay was built
+    // with OpenImageDenoise
+    bool denoiser_available = false;
+    if (denoise) {
+        try {
+            denoiser_available = ospLoadModule("denoiser") == OSP_NO_ERROR;
+        } catch (const std::runtime_error &) {
+        }
+        if (!denoiser_available) {
+            std::cerr << "The OSPRay denoiser module is not available, not denoising\n";
+            denoise = false;
+        }
+    }
+
     cam_eye = arcball.eye();
     glm::vec3 cam_dir = arcball.dir();
     cam_up = arcball.up();
     glm::vec3 cam_right = cross(cam_dir, cam_up);
 
+    const float fovy = 40.f;
     cpp::Camera camera("perspective");
     camera.setParam("aspect", static_cast<float>(win_width) / win_height);
     camera.setParam("position", cam_eye);
     camera.setParam("direction", cam_dir);
     camera.setParam("up", cam_up);
-    camera.setParam("fovy", 40.f);
+    camera.setParam("fovy", fovy);
     camera.commit();
 
 
@@ -614,86 +1682,97 @@ void run_app(const std::vector<std::string> &args, SDL_Window *window)
     mesh.setParam("glyph.eigvec1", cpp::CopiedData(eigvec1));
     mesh.setParam("glyph.eigvec2", cpp::CopiedData(eigvec2));
     mesh.commit();
+    std::vector<cpp::Instance> instances = {makeInstance(mesh)};
     #else
 
-    if (cmdline_file) {
-        std::cout << "z slice: " << z/2 << "\n";
-        std::vector<float> slice(&coeffs[getSHIndex(strides,x,y,z, 0,0,z/2)], &coeffs[getSHIndex(strides,x,y,z,0,0,z/2+1)]);
-        coeffs = slice;
-        z = 1;
-    }
-
-
-    std::vector<glm::vec3> positions;
-    if (cmdline_file)
-        positions = latVolNodes(x,y,z, strides, geometry_scale);
-    else
-        positions = latVolNodes(2,1,1, strides, geometry_scale);
-
-    if (!cmdline_file)
-        coeffs = makeRandomCoeffs(positions.size(), 1);
-
     // SHRenderMethod shRenderMethod = SHRenderMethod::NewtonBisection;
     // SHRenderMethod shRenderMethod = SHRenderMethod::Laguerre;
     // SHRenderMethod shRenderMethod = SHRenderMethod::Wigner;
     SHRenderMethod shRenderMethod = SHRenderMethod::Naive;
 
-    std::vector<glm::vec3> wignerAngles;
-    std::vector<float> rotatedCoeffs;
-    std::vector<float> boundRadius;
-    if (shRenderMethod == SHRenderMethod::Wigner) {
-        wignerAngles.resize(positions.size());
-        computeWignerAngles(cam_up, cam_eye, positions, wignerAngles);
-        rotatedCoeffs.resize(coeffs.size());
-        rotateSH(coeffs, rotatedCoeffs, wignerAngles);
-    }
-    if (use_cylinder) {
-        boundRadius.resize(positions.size());
-        computeBoundRadius(coeffs, boundRadius);
+    GlyphSource source;
+    source.npy_basis = npy_basis;
+    source.bricked = bricked_file;
+    source.brick_budget_mb = brick_budget_mb;
+    source.geometry_scale = geometry_scale;
+    source.sh_scale = sh_scale;
+    source.sh_0_scale = sh_0_scale;
+    source.use_cylinder = use_cylinder;
+    source.glyph_cache_dir = glyph_cache_dir;
+    source.mask_file = mask_file;
+    source.c0_threshold = c0_threshold;
+    source.gfa_threshold = gfa_threshold;
+    source.slice_axis = slice_axis;
+    source.slice_offset = slice_offset;
+    // Headless renders only the shown slice, building its neighbours would
+    // compete with the renderer for the pool and skew the timings
+    source.prebuilt_slices = headless ? 0 : prebuilt_slices;
+    // Only the whole volume is clipped, starting out with nothing clipped
+    // away until the volume size is known
+    float clip_box[6] = {-1e30f, -1e30f, -1e30f, 1e30f, 1e30f, 1e30f};
+    int clip_lo[3] = {0, 0, 0};
+    int clip_hi[3] = {-1, -1, -1};
+    bool clip_changed = false;
+    // When the clip box was last moved, until a frame reflects it
+    std::chrono::steady_clock::time_point clip_moved;
+    bool clip_pending = false;
+    // Shown when the clip box last moved, still shown until the rebuilt
+    // slice replaces it
+    std::shared_ptr<GlyphSlice> unclipped_slice;
+    if (slice_axis == volumeAxis) {
+        source.clip_box = clip_box;
+        source.clip_rebuild = clip_rebuild;
     }
-
-    for (int i = 0; i < coeffs.size(); i+=15) {
-        coeffs[i] *= sh_0_scale;
-        for (int j = 0; j < 15; ++j)
-            coeffs[i+j] *= sh_scale;
+    source.shRenderMethod = shRenderMethod;
+    source.camera = camera;
+    source.cam_up = cam_up;
+    source.cam_eye = cam_eye;
+    // Headless renders may go on to other cameras, so load everything
+    if (bricked_file && slice_axis == volumeAxis && !headless)
+        source.view = makeFrustum(
+            cam_eye, cam_dir, cam_up, fovy, static_cast<float>(win_width) / win_height);
+
+    // One source per timestep, from the files of a series and the
+    // timesteps of 5D volumes
+    std::vector<GlyphSource> timesteps;
+    if (series_files.empty() && cmdline_file)
+        series_files.push_back(filename);
+    for (const auto &file : series_files) {
+        source.filename = file;
+        const int n = bricked_file ? 1 : read_sh_header(file, npy_basis).timesteps;
+        for (source.timestep = 0; source.timestep < n; ++source.timestep)
+            timesteps.push_back(source);
     }
-
-    cpp::Geometry mesh("spherical_harmonics");
-    mesh.setParam("glyph.position", cpp::CopiedData(positions));
-    mesh.setParam("glyph.coefficients", cpp::CopiedData(coeffs));
-    mesh.setParam("glyph.shRenderMethod", (uint)shRenderMethod);
-    mesh.setParam("glyph.useCylinder", use_cylinder);
-    if (shRenderMethod == SHRenderMethod::Wigner) {
-        mesh.setParam("glyph.rotatedCoefficients", cpp::CopiedData(rotatedCoeffs));
-        mesh.setParam("glyph.camera", camera);
-    }
-    if (use_cylinder)
-        mesh.setParam("glyph.boundRadius", cpp::CopiedData(boundRadius));
-
-    mesh.commit();
+    if (timesteps.empty())
+        timesteps.push_back(source);
+    if (timesteps.size() > 1)
+        std::cout << "Time series of " << timesteps.size() << " timesteps\n";
+
+    // Loaders of the displayed timestep and its neighbours, which are
+    // prefetched once it is loaded so stepping through the series does not
+    // wait on the disk. Glyphs show up batch by batch as the loader of the
+    // displayed timestep gets to them, the world starts out empty.
+    std::map<int, std::unique_ptr<GlyphLoader>> loaders;
+    // Loaders of timesteps no longer needed, kept until they are cancelled
+    // and the update sent with them retired is applied
+    std::vector<std::unique_ptr<GlyphLoader>> retiring;
+    std::vector<std::pair<size_t, std::unique_ptr<GlyphLoader>>> retired;
+    int timestep = 0;
+    int shown_timestep = -1;
+    // Known once the first loader has opened its volume
+    int slice_index = -1;
+    int shown_axis = slice_axis;
+    int shown_index = -1;
+    // The slice whose batches are in the world
+    std::shared_ptr<GlyphSlice> shown_slice;
+    const GlyphLoader *shown_loader = nullptr;
+    size_t published = 0;
+    size_t shown_glyphs = 0;
+    std::vector<cpp::Instance> instances;
+    std::vector<std::shared_ptr<GlyphBatch>> batches;
 
     #endif
 
-    // put the mesh into a model
-    cpp::GeometricModel model(mesh);
-    #if 0
-    float ns = 10.0f;
-    glm::vec3 ks = glm::vec3(1.0f, 1.0f, 1.0f);
-    OSPMaterial material = ospNewMaterial("sphharm", "obj");
-    ospSetParam(material, "ks", OSP_VEC3F, &ks);
-    ospSetParam(material, "ns", OSP_FLOAT, &ns);
-    ospCommit(material);
-    model.setParam("material", material);
-    #endif
-    model.commit();
-
-    cpp::Group group;
-    group.setParam("geometry", cpp::CopiedData(model));
-    group.commit();
-
-    cpp::Instance instance(group);
-    instance.commit();
-
     cpp::Light light("ambient");
     light.setParam("intensity", 0.05f);
     light.commit();
@@ -704,32 +1783,126 @@ void run_app(const std::vector<std::string> &args, SDL_Window *window)
 
     cpp::World world;
     std::vector<cpp::Light> lights = {light, dir_light};
-    world.setParam("instance", cpp::CopiedData(instance));
+    if (!instances.empty())
+        world.setParam("instance", cpp::CopiedData(instances));
     world.setParam("light", cpp::CopiedData(lights));
     world.commit();
 
-    cpp::FrameBuffer fb(win_width, win_height, OSP_FB_SRGBA, OSP_FB_COLOR | OSP_FB_ACCUM);
-    fb.clear();
+    if (headless) {
+        #if renderSH
+        // Everything shown is loaded before rendering starts
+        GlyphLoader loader(timesteps[0]);
+        std::shared_ptr<GlyphSlice> slice = loader.waitForFirstSlice();
+        const std::string load_error = loader.takeError();
+        if (!load_error.empty() || !slice) {
+            std::cerr << "Failed to load " << timesteps[0].filename << ": " << load_error
+                      << "\n";
+            return;
+        }
+        batches = loader.batchesSince(*slice, 0);
+        for (auto &batch : batches)
+            instances.push_back(batch->instance);
+        world.setParam("instance", cpp::CopiedData(instances));
+        {
+            PhaseTimer::Scope phase(startup_timer, "world commit");
+            world.commit();
+        }
+        #endif
+
+        // One image per camera of the list, eye center up on each line as
+        // the p key prints them, or of the camera set up above
+        std::vector<ArcballCamera> cameras;
+        if (!headless_cameras.empty()) {
+            std::ifstream cam_in(headless_cameras);
+            std::string line;
+            while (std::getline(cam_in, line)) {
+                std::stringstream values(line);
+                if (line.compare(0, 7, "-camera") == 0)
+                    values.ignore(7);
+                glm::vec3 eye, at, up;
+                if (values >> eye.x >> eye.y >> eye.z >> at.x >> at.y >> at.z >> up.x >> up.y
+                    >> up.z)
+                    cameras.emplace_back(eye, at, up);
+            }
+            if (cameras.empty()) {
+                std::cerr << "No cameras in " << headless_cameras << "\n";
+                return;
+            }
+        } else {
+            cameras.push_back(arcball);
+        }
+
+        cpp::FrameBuffer fb(
+            headless_width, headless_height, OSP_FB_SRGBA, OSP_FB_COLOR | OSP_FB_ACCUM);
+        camera.setParam("aspect", static_cast<float>(headless_width) / headless_height);
+        for (size_t c = 0; c < cameras.size(); ++c) {
+            cam_eye = cameras[c].eye();
+            cam_dir = cameras[c].dir();
+            cam_up = cameras[c].up();
+            camera.setParam("position", cam_eye);
+            camera.setParam("direction", cam_dir);
+            camera.setParam("up", cam_up);
+            camera.commit();
+            #if renderSH
+            if (shRenderMethod == SHRenderMethod::Wigner) {
+                for (auto &batch : batches) {
+                    rotateBatch(*batch, cam_up, cam_eye);
+                    batch->mesh.commit();
+                }
+            }
+            #endif
+
+            // Accumulate a sample per pixel a frame, up to the count or
+            // until the time budget runs out
+            fb.clear();
+            const auto start = std::chrono::steady_clock::now();
+            int samples = 0;
+            double seconds = 0.0;
+            while (samples < headless_samples
+                   && (headless_budget <= 0.f || seconds < headless_budget)) {
+                fb.renderFrame(renderer, camera, world).wait();
+                ++samples;
+                seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+                              .count();
+            }
+
+            std::string out_file = headless_output;
+            if (cameras.size() > 1) {
+                char suffix[16];
+                std::snprintf(suffix, sizeof(suffix), "_%04zu", c);
+                const size_t ext = out_file.rfind('.');
+                out_file.insert(ext == std::string::npos ? out_file.size() : ext, suffix);
+            }
+            uint32_t *img = (uint32_t *)fb.map(OSP_FB_COLOR);
+            stbi_flip_vertically_on_write(1);
+            stbi_write_png(out_file.c_str(),
+                           headless_width,
+                           headless_height,
+                           4,
+                           img,
+                           headless_width * 4);
+            stbi_flip_vertically_on_write(0);
+            fb.unmap(img);
+            std::cout << "Wrote " << out_file << ", " << samples << " samples in " << seconds
+                      << "s\n";
+        }
+        if (report_timing) {
+            std::cout << "Timing:\n";
+            startup_timer.print(std::cout);
+            if (!timing_json_file.empty()) {
+                std::ofstream json_out(timing_json_file);
+                json_out << startup_timer.to_json().dump(4) << "\n";
+                std::cout << "Timing written to " << timing_json_file << "\n";
+            }
+        }
+        return;
+    }
+
     Shader display_render(fullscreen_quad_vs, display_texture_fs);
     display_render.uniform("img", 0);
 
-    GLuint render_texture;
-    glGenTextures(1, &render_texture);
-    glBindTexture(GL_TEXTURE_2D, render_texture);
-    glTexImage2D(GL_TEXTURE_2D,
-                 0,
-                 GL_RGBA8,
-                 win_width,
-                 win_height,
-                 0,
-                 GL_RGBA,
-                 GL_UNSIGNED_BYTE,
-                 nullptr);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Frames reach the display texture through pixel buffers
+    TextureStream render_texture(win_width, win_height);
 
     GLuint vao;
     glGenVertexArrays(1, &vao);
@@ -738,9 +1911,315 @@ void run_app(const std::vector<std::string> &args, SDL_Window *window)
     glClearColor(0.0, 0.0, 0.0, 0.0);
     glDisable(GL_DEPTH_TEST);
 
-    // Start rendering asynchronously
-    cpp::Future future = fb.renderFrame(renderer, camera, world);
+    // Frames are rendered, committed and read back on their own thread, so
+    // the UI keeps up with the display however long a frame takes. The UI
+    // thread sends it its scene changes as updates and takes the newest
+    // finished frame from it each pass. Once it is started, the camera,
+    // world, framebuffer and culled clip box are only touched by the render
+    // thread and the changes it applies.
+    SPSCQueue<RenderUpdate, 64> render_updates;
+    TripleBuffer<RenderedFrame> rendered_frames;
+    size_t updates_sent = 0;
+    // Updates the world has been committed with
+    std::atomic<size_t> updates_applied{0};
+    std::atomic<bool> render_quit{false};
+    // Wakes the render thread when an update comes in or its frame is done.
+    // update_queued is set under the mutex with each push, so a wakeup sent
+    // between the render thread's last pop and its wait is not lost.
+    std::mutex render_wake_mutex;
+    std::condition_variable render_wake;
+    bool update_queued = false;
+    // Set when the render thread has nothing to render until it gets an
+    // update, before the updates it went idle with count as applied
+    std::atomic<bool> render_idle{false};
+    // Pushed by the render thread with the frame it converged on, to wake
+    // the UI thread if it waits for events
+    const Uint32 frame_ready_event = SDL_RegisterEvents(1);
+
+    // Denoised frames are rendered to float framebuffers with the albedo
+    // and normals of the glyphs, which guide the denoiser, and encoded to
+    // sRGB on readback
+    bool denoising = denoise;
+    cpp::ImageOperation denoiser;
+    if (denoiser_available)
+        denoiser = cpp::ImageOperation("denoiser");
+    auto makeFrameBuffer = [&](int width, int height, bool accumulate) {
+        const int channels =
+            OSP_FB_COLOR | (accumulate ? OSP_FB_ACCUM | OSP_FB_VARIANCE : 0);
+        if (!denoising)
+            return cpp::FrameBuffer(width, height, OSP_FB_SRGBA, channels);
+        cpp::FrameBuffer denoised(
+            width, height, OSP_FB_RGBA32F, channels | OSP_FB_ALBEDO | OSP_FB_NORMAL);
+        denoised.setParam("imageOperation", cpp::CopiedData(denoiser));
+        denoised.commit();
+        return denoised;
+    };
+    cpp::FrameBuffer fb = makeFrameBuffer(win_width, win_height, true);
+    int fb_width = win_width;
+    int fb_height = win_height;
+    cpp::FrameBuffer reduced_fb;
+    int reduced_width = 0;
+    int reduced_height = 0;
+    // Reset whenever the framebuffer is cleared, along with the measuring of
+    // how long the new view takes to settle
+    size_t accumulated_samples = 0;
+    bool converged = false;
+    std::chrono::steady_clock::time_point view_start;
+    bool view_settled = false;
+    QualityReport quality;
+    auto clearAccumulation = [&]() {
+        fb.clear();
+        accumulated_samples = 0;
+        converged = false;
+        view_start = std::chrono::steady_clock::now();
+        view_settled = false;
+    };
+    clearAccumulation();
     std::vector<OSPObject> pending_commits;
+    FrameTags applied_tags;
+
+    // The slots the render thread writes first get their buffers up front,
+    // the middle one once it passes through the UI thread
+    render_texture.map(rendered_frames.write_slot().mapped, size_t(win_width) * win_height);
+    render_texture.map(rendered_frames.read_slot().mapped, size_t(win_width) * win_height);
+
+    std::thread render_thread([&]() {
+        std::vector<RenderUpdate> waiting;
+        FrameTags frame_tags;
+        bool cancelled = false;
+
+        // While the camera moves, frames go to a framebuffer at a fraction
+        // of the resolution, without accumulation, with the fraction adapted
+        // to render them at the interactive frame rate. Once the camera has
+        // been still for a moment they are accumulated at full size again.
+        const float target_seconds = interactive_fps > 0.f ? 1.f / interactive_fps : 0.f;
+        const float min_render_scale = 0.25f;
+        const std::chrono::milliseconds interaction_settle(150);
+        std::chrono::steady_clock::time_point last_interaction;
+        float interactive_scale = 1.f;
+        // Where the frame in flight goes
+        cpp::FrameBuffer *frame_fb = &fb;
+        int frame_width = 0;
+        int frame_height = 0;
+        bool frame_reduced = false;
+
+        cpp::Future future;
+        bool rendering = false;
+        // The frame in flight is waited for on frame_waiter, which wakes this
+        // thread through render_wake once it is done. Guarded by
+        // render_wake_mutex.
+        std::condition_variable frame_started;
+        cpp::Future waited_frame;
+        size_t frames_started = 0;
+        size_t frames_finished = 0;
+        auto start_frame = [&]() {
+            frame_reduced = target_seconds > 0.f
+                && std::chrono::steady_clock::now() - last_interaction < interaction_settle;
+            if (frame_reduced) {
+                // In steps of 1/8, so the framebuffer and display texture
+                // are not reallocated for every small change
+                const float scale = std::max(std::round(interactive_scale * 8.f) / 8.f,
+                                             min_render_scale);
+                const int width = std::max(int(fb_width * scale), 1);
+                const int height = std::max(int(fb_height * scale), 1);
+                if (width != reduced_width || height != reduced_height) {
+                    reduced_fb = makeFrameBuffer(width, height, false);
+                    reduced_width = width;
+                    reduced_height = height;
+                }
+                frame_fb = &reduced_fb;
+                frame_width = width;
+                frame_height = height;
+            } else {
+                frame_fb = &fb;
+                frame_width = fb_width;
+                frame_height = fb_height;
+            }
+            future = frame_fb->renderFrame(renderer, camera, world);
+            frame_tags = applied_tags;
+            rendering = true;
+            {
+                std::lock_guard<std::mutex> lock(render_wake_mutex);
+                waited_frame = future;
+                ++frames_started;
+            }
+            frame_started.notify_one();
+        };
+        std::thread frame_waiter([&]() {
+            std::unique_lock<std::mutex> lock(render_wake_mutex);
+            size_t seen = 0;
+            while (true) {
+                frame_started.wait(lock, [&]() { return frames_started != seen || render_quit; });
+                if (frames_started == seen)
+                    return;
+                seen = frames_started;
+                cpp::Future frame = waited_frame;
+                lock.unlock();
+                frame.wait();
+                lock.lock();
+                frames_finished = seen;
+                render_wake.notify_one();
+            }
+        });
+        start_frame();
+        // Time spent on the changes and commits before the frame in flight
+        float commit_seconds = 0.f;
+        // The write slot holds a frame the UI thread skipped
+        bool frame_skipped = false;
+        while (!render_quit) {
+            RenderUpdate update;
+            bool cancel = false;
+            while (render_updates.pop(update)) {
+                cancel |= update.cancel_frame;
+                waiting.push_back(std::move(update));
+            }
+            if (!rendering) {
+                if (waiting.empty()) {
+                    // Converged, so nothing is rendered until the UI thread
+                    // sends an update or quits
+                    std::unique_lock<std::mutex> lock(render_wake_mutex);
+                    render_wake.wait(lock, [&]() {
+                        return update_queued || render_quit || !converged;
+                    });
+                    update_queued = false;
+                    continue;
+                }
+                // Nothing in flight to read back
+                cancelled = true;
+            }
+            // A frame of a view that has since changed is not worth
+            // finishing, cancel it and start over from the newest state
+            if (cancel && !cancelled && !future.isReady()) {
+                future.cancel();
+                future.wait();
+                cancelled = true;
+            }
+            if (!cancelled && !future.isReady()) {
+                // Sleep until the frame is done or an update comes in that
+                // may cancel it
+                std::unique_lock<std::mutex> lock(render_wake_mutex);
+                render_wake.wait(lock, [&]() {
+                    return frames_finished == frames_started || update_queued || render_quit;
+                });
+                update_queued = false;
+                continue;
+            }
+            rendering = false;
+
+            if (!cancelled) {
+                if (frame_reduced) {
+                    // The render time goes with the number of pixels
+                    interactive_scale *=
+                        std::sqrt(target_seconds / std::max(future.duration(), 1e-4f));
+                    interactive_scale =
+                        std::max(std::min(interactive_scale, 1.f), min_render_scale);
+                }
+
+                FrameStats stats;
+                stats.width = frame_width;
+                stats.height = frame_height;
+                stats.samples = frame_reduced ? 1 : ++accumulated_samples;
+                if (!frame_reduced) {
+                    // The estimate needs two samples to go on
+                    stats.variance = accumulated_samples > 1 ? fb.variance() : 0.f;
+                    converged = int(accumulated_samples) >= max_samples
+                        || (accumulated_samples > 1 && stats.variance < variance_threshold);
+                }
+                stats.commit_seconds = commit_seconds;
+                stats.render_seconds = future.duration();
+                const auto map_start = std::chrono::steady_clock::now();
+
+                RenderedFrame &frame = rendered_frames.write_slot();
+                frame.width = frame_width;
+                frame.height = frame_height;
+                const size_t n_pixels = size_t(frame_width) * frame_height;
+                frame.in_mapped = frame.mapped.data && frame.mapped.capacity >= n_pixels;
+                if (!frame.in_mapped)
+                    frame.pixels.resize(n_pixels);
+                uint32_t *dst = frame.in_mapped ? frame.mapped.data : frame.pixels.data();
+                if (denoising) {
+                    float *img = (float *)frame_fb->map(OSP_FB_COLOR);
+                    linearToSRGBA8(img, n_pixels, dst);
+                    frame_fb->unmap(img);
+                } else {
+                    uint32_t *img = (uint32_t *)frame_fb->map(OSP_FB_COLOR);
+                    std::copy(img, img + n_pixels, dst);
+                    frame_fb->unmap(img);
+                }
+                stats.map_seconds = std::chrono::duration<float>(
+                    std::chrono::steady_clock::now() - map_start).count();
+
+                // Judged by the same variance estimate as convergence, so
+                // no second pass over the image is needed
+                if (!frame_reduced && !view_settled && accumulated_samples > 1
+                    && stats.variance < quality_threshold) {
+                    view_settled = true;
+                    ++quality.views;
+                    quality.denoised = denoising;
+                    quality.samples = accumulated_samples;
+                    quality.seconds = std::chrono::duration<float>(
+                        std::chrono::steady_clock::now() - view_start).count();
+                }
+                frame.quality = quality;
+                frame.converged = converged;
+                if (!frame_skipped)
+                    frame.stats.clear();
+                frame.stats.push_back(stats);
+                frame.tags = frame_tags;
+                frame_skipped = rendered_frames.publish();
+                if (converged) {
+                    SDL_Event ready = {};
+                    ready.type = frame_ready_event;
+                    SDL_PushEvent(&ready);
+                }
+            }
+            cancelled = false;
+
+            const auto commit_start = std::chrono::steady_clock::now();
+            for (auto &u : waiting) {
+                for (auto &change : u.changes)
+                    change();
+                applied_tags = u.tags;
+                if (u.interacting)
+                    last_interaction = std::chrono::steady_clock::now();
+            }
+            if (!pending_commits.empty()) {
+                clearAccumulation();
+            }
+            for (auto &c : pending_commits) {
+                if (c == world.handle()) {
+                    PhaseTimer::Scope phase(startup_timer, "world commit");
+                    ospCommit(c);
+                } else {
+                    ospCommit(c);
+                }
+            }
+            pending_commits.clear();
+            render_idle = converged;
+            // The changes hold on to the slices they swapped out until here,
+            // where the world no longer references them. They go before the
+            // updates count as applied, as that lets the UI thread free the
+            // volumes of retired loaders.
+            const size_t applied = waiting.size();
+            waiting.clear();
+            updates_applied.fetch_add(applied, std::memory_order_release);
+            commit_seconds = std::chrono::duration<float>(
+                std::chrono::steady_clock::now() - commit_start).count();
+
+            // Any change clears the accumulation and starts it over
+            if (!converged)
+                start_frame();
+        }
+        if (rendering) {
+            future.cancel();
+            future.wait();
+        }
+        {
+            std::lock_guard<std::mutex> lock(render_wake_mutex);
+            frame_started.notify_one();
+        }
+        frame_waiter.join();
+    });
 
     ImGuiIO &io = ImGui::GetIO();
     glm::vec2 prev_mouse(-2.f);
@@ -748,13 +2227,63 @@ void run_app(const std::vector<std::string> &args, SDL_Window *window)
     bool camera_changed = true;
     bool window_changed = false;
     bool take_screenshot = false;
-    const static int framesAveraged = 16;
-    std::array<float, framesAveraged> frameTime = {0};
-    int frameIndex = 0;
-    int framesRecorded = 0;
+    FrameTags tags;
+    FrameTags sent_tags = applied_tags;
+    // The earliest camera input not yet on screen, and how many came before
+    size_t inputs = 0;
+    std::chrono::steady_clock::time_point input_time;
+    bool input_waiting = false;
+    size_t waiting_input = 0;
+    float input_latency_ms = -1.f;
+    // The last view measured without and with the denoiser
+    QualityReport settled[2];
+    size_t quality_views = 0;
+    bool denoise_ui = denoise;
+    bool render_converged = false;
+    // CPU use of the whole process, sampled about once a second
+    double cpu_seconds = process_cpu_seconds();
+    auto cpu_sampled = std::chrono::steady_clock::now();
+    float cpu_percent = 0.f;
+    // Toggled with F1
+    bool show_perf = true;
+    const static size_t perfFramesShown = 256;
+    const static size_t perfHistoryFrames = 4096;
+    // Enough frames for the panel and a CSV of the last minute or so
+    FrameHistory history(perfHistoryFrames);
+    // Keyframes recorded since R was pressed
+    bool recording = false;
+    std::chrono::steady_clock::time_point record_start;
+    std::vector<CameraKeyframe> recorded;
+    // Each replayed camera is rendered once the frame of the previous one
+    // is on screen, so every run renders the same frames
+    std::vector<CameraKeyframe> replay;
+    if (!replay_path_file.empty()) {
+        replay = read_camera_path(replay_path_file);
+        if (replay.size() < 2)
+            throw std::runtime_error(replay_path_file + ": need at least 2 keyframes");
+    }
+    const size_t replay_total = replay.empty() ? 0 : (replay.size() - 1) * replay_frames + 1;
+    size_t replay_frame = 0;
+    bool replay_waiting = false;
+    size_t replay_inputs = 0;
+    FrameHistory replay_history(replay_total);
+    // Set when nothing is rendering, loading, replaying or settling in the
+    // UI, then the loop sleeps until there is input or a frame comes in
+    bool idle = false;
+    int quiet_passes = 0;
+    const static int idleWaitMs = 250;
+    // Changes the full update queue had no room for yet
+    RenderUpdate unsent;
+    bool unsent_pending = false;
     while (!done) {
+        RenderUpdate update;
         SDL_Event event;
-        while (SDL_PollEvent(&event)) {
+        bool had_input = false;
+        for (bool more = idle ? SDL_WaitEventTimeout(&event, idleWaitMs)
+                              : SDL_PollEvent(&event);
+             more;
+             more = SDL_PollEvent(&event)) {
+            had_input |= event.type != frame_ready_event;
             ImGui_ImplSDL2_ProcessEvent(&event);
             if (event.type == SDL_QUIT) {
                 done = true;
@@ -771,7 +2300,31 @@ void run_app(const std::vector<std::string> &args, SDL_Window *window)
                               << " " << up.x << " " << up.y << " " << up.z << "\n";
                 } else if (event.key.keysym.sym == SDLK_c) {
                     take_screenshot = true;
+                } else if (event.key.keysym.sym == SDLK_F1) {
+                    show_perf = !show_perf;
+                } else if (event.key.keysym.sym == SDLK_r) {
+                    recording = !recording;
+                    if (recording) {
+                        record_start = std::chrono::steady_clock::now();
+                        recorded.clear();
+                        recorded.emplace_back(0.0, arcball);
+                        std::cout << "Recording camera path" << std::endl;
+                    } else {
+                        write_camera_path(record_path_file, recorded);
+                        std::cout << "Camera path of " << recorded.size()
+                                  << " keyframes saved to '" << record_path_file << "'"
+                                  << std::endl;
+                    }
+                }
+                #if renderSH
+                else if (event.key.keysym.sym == SDLK_PAGEUP && slice_index >= 0
+                         && slice_axis != volumeAxis) {
+                    ++slice_index;
+                } else if (event.key.keysym.sym == SDLK_PAGEDOWN && slice_index >= 0
+                           && slice_axis != volumeAxis) {
+                    --slice_index;
                 }
+                #endif
             }
             if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE &&
                 event.window.windowID == SDL_GetWindowID(window)) {
@@ -804,119 +2357,495 @@ void run_app(const std::vector<std::string> &args, SDL_Window *window)
                 io.DisplaySize.x = win_width;
                 io.DisplaySize.y = win_height;
 
-                camera.setParam("aspect", static_cast<float>(win_width) / win_height);
-                pending_commits.push_back(camera.handle());
-
-                // make new framebuffer
-                fb = cpp::FrameBuffer(
-                    win_width, win_height, OSP_FB_SRGBA, OSP_FB_COLOR | OSP_FB_ACCUM);
-                fb.clear();
-
-                glDeleteTextures(1, &render_texture);
-                glGenTextures(1, &render_texture);
-                // Setup the render textures for color and normals
-                glBindTexture(GL_TEXTURE_2D, render_texture);
-                glTexImage2D(GL_TEXTURE_2D,
-                             0,
-                             GL_RGBA8,
-                             win_width,
-                             win_height,
-                             0,
-                             GL_RGBA,
-                             GL_UNSIGNED_BYTE,
-                             nullptr);
-
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                const int width = win_width;
+                const int height = win_height;
+                update.changes.push_back([&, width, height]() {
+                    camera.setParam("aspect", static_cast<float>(width) / height);
+                    pending_commits.push_back(camera.handle());
+
+                    // make new framebuffer
+                    fb = makeFrameBuffer(width, height, true);
+                    clearAccumulation();
+                    fb_width = width;
+                    fb_height = height;
+                });
             }
         }
 
+        if (replay_frame < replay_total && !replay_waiting) {
+            const size_t segment =
+                std::min(replay_frame / replay_frames, replay.size() - 2);
+            const float t = float(replay_frame - segment * replay_frames) / replay_frames;
+            arcball = interpolate_camera(replay[segment].camera, replay[segment + 1].camera, t);
+            camera_changed = true;
+            replay_waiting = true;
+        }
+        if (camera_changed && recording) {
+            recorded.emplace_back(
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - record_start)
+                    .count(),
+                arcball);
+        }
+
         if (camera_changed) {
+            ++inputs;
+            if (replay_waiting)
+                replay_inputs = inputs;
+            if (!input_waiting) {
+                input_time = std::chrono::steady_clock::now();
+                input_waiting = true;
+                waiting_input = inputs;
+            }
             cam_eye = arcball.eye();
             cam_dir = arcball.dir();
             cam_up = arcball.up();
 
-            camera.setParam("position", cam_eye);
-            camera.setParam("direction", cam_dir);
-            camera.setParam("up", cam_up);
-            pending_commits.push_back(camera.handle());
+            update.changes.push_back([&, cam_eye, cam_dir, cam_up]() {
+                camera.setParam("position", cam_eye);
+                camera.setParam("direction", cam_dir);
+                camera.setParam("up", cam_up);
+                pending_commits.push_back(camera.handle());
+            });
 
             #if renderSH
             if (shRenderMethod == SHRenderMethod::Wigner) {
-                computeWignerAngles(cam_up, cam_eye, positions, wignerAngles);
-                rotateSH(coeffs, rotatedCoeffs, wignerAngles);
-                mesh.setParam("glyph.rotatedCoefficients", cpp::CopiedData(rotatedCoeffs));
-                pending_commits.push_back(mesh.handle());
+                update.changes.push_back([&, cam_eye, cam_up, rotated = batches]() {
+                    for (auto &batch : rotated) {
+                        rotateBatch(*batch, cam_up, cam_eye);
+                        pending_commits.push_back(batch->mesh.handle());
+                    }
+                });
             }
             #endif
         }
 
+        #if renderSH
+        if (bricked_file && slice_axis == volumeAxis && (camera_changed || window_changed)) {
+            // Bricks coming into view are paged in, by loaders started
+            // later too
+            const ViewFrustum view = makeFrustum(
+                cam_eye, cam_dir, cam_up, fovy, static_cast<float>(win_width) / win_height);
+            for (auto &t : timesteps)
+                t.view = view;
+            for (auto &l : loaders)
+                l.second->showView(view);
+        }
+        if (timestep != shown_timestep) {
+            // Retire the loaders that are not the new timestep or its
+            // neighbours, they are cancelled and reaped below
+            for (auto it = loaders.begin(); it != loaders.end();) {
+                if (std::abs(it->first - timestep) > 1) {
+                    it->second->stop();
+                    retiring.push_back(std::move(it->second));
+                    it = loaders.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            if (!loaders.count(timestep)) {
+                loaders[timestep].reset(new GlyphLoader(timesteps[timestep]));
+                if (slice_index >= 0)
+                    loaders[timestep]->showSlice(shown_axis, slice_index);
+            }
+            shown_timestep = timestep;
+        }
+        GlyphLoader *loader = loaders[timestep].get();
+        if (slice_index < 0 && loader->ready)
+            slice_index = loader->firstSlice();
+        if (slice_index >= 0) {
+            if (loader->ready)
+                slice_index =
+                    std::max(std::min(slice_index, loader->sliceCount(slice_axis) - 1), 0);
+            if (slice_axis != shown_axis || slice_index != shown_index) {
+                // All loaders follow, so the prefetched timesteps have the
+                // same slice ready
+                for (auto &l : loaders)
+                    l.second->showSlice(slice_axis, slice_index);
+                shown_axis = slice_axis;
+                shown_index = slice_index;
+            }
+        }
+
+        // Swap in the glyphs of a new slice or timestep, as far as they are
+        // built. Prebuilt slices only change the instances the world holds.
+        auto slice = slice_index >= 0 ? loader->slice(shown_axis, shown_index) : nullptr;
+        // Keep showing a slice dropped to rebuild it clipped until the
+        // rebuilt one starts coming in
+        const bool rebuilding = !slice && shown_slice && shown_loader == loader
+            && shown_slice->axis == shown_axis && shown_slice->index == shown_index;
+        if (slice != shown_slice && !rebuilding) {
+            // The slice swapped out is kept until the world is committed
+            // without it
+            update.changes.push_back([&, stale = shown_slice]() {
+                world.removeParam("instance");
+                pending_commits.push_back(world.handle());
+            });
+            shown_slice = slice;
+            shown_loader = loader;
+            published = 0;
+            shown_glyphs = 0;
+            instances.clear();
+            batches.clear();
+        }
+        // Prefetch the neighbours once the displayed timestep is in
+        if (shown_slice && shown_slice->done) {
+            for (int t : {timestep + 1, timestep - 1}) {
+                if (t >= 0 && t < int(timesteps.size()) && !loaders.count(t)) {
+                    loaders[t].reset(new GlyphLoader(timesteps[t]));
+                    loaders[t]->showSlice(shown_axis, shown_index);
+                }
+            }
+        }
+
+        // Add the batches the loader finished since the last frame, only the
+        // world is recommitted since their groups are already built
+        const std::string load_error = loader->takeError();
+        if (!load_error.empty()) {
+            std::cerr << "Failed to load " << timesteps[timestep].filename << ": "
+                      << load_error << "\n";
+            done = true;
+        }
+        auto arrived = shown_slice ? loader->batchesSince(*shown_slice, published)
+                                   : std::vector<std::shared_ptr<GlyphBatch>>();
+        if (!arrived.empty()) {
+            for (auto &batch : arrived) {
+                instances.push_back(batch->instance);
+                batches.push_back(batch);
+                shown_glyphs += batch->positions.size();
+            }
+            published += arrived.size();
+            update.changes.push_back([&, arrived, cam_eye, cam_up, shown = instances]() {
+                if (shRenderMethod == SHRenderMethod::Wigner) {
+                    for (auto &batch : arrived) {
+                        rotateBatch(*batch, cam_up, cam_eye);
+                        pending_commits.push_back(batch->mesh.handle());
+                    }
+                }
+                world.setParam("instance", cpp::CopiedData(shown));
+                pending_commits.push_back(world.handle());
+            });
+        }
+        #endif
+
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplSDL2_NewFrame();
         ImGui::NewFrame();
 
+        #if renderSH
+        if (timesteps.size() > 1) {
+            ImGui::Begin("Time series");
+            ImGui::SliderInt("Timestep", &timestep, 0, int(timesteps.size()) - 1);
+            ImGui::End();
+        }
+        if (slice_axis == volumeAxis && loader->ready) {
+            if (clip_hi[0] < 0) {
+                for (int d = 0; d < 3; ++d)
+                    clip_hi[d] = loader->dims[d] - 1;
+            }
+            ImGui::Begin("Clip");
+            const char *axis_names[3] = {"x", "y", "z"};
+            for (int d = 0; d < 3; ++d) {
+                clip_changed |= ImGui::DragIntRange2(
+                    axis_names[d], &clip_lo[d], &clip_hi[d], 0.25f, 0, loader->dims[d] - 1);
+            }
+            ImGui::End();
+        }
+        if (clip_changed) {
+            clip_moved = std::chrono::steady_clock::now();
+            clip_pending = true;
+        }
+        if (clip_changed && clip_rebuild) {
+            // The geometry does not see the box, so it can change right
+            // away. Loaders started later pick it up from here.
+            clip_changed = false;
+            // Bounds of the voxels in the range, in world space
+            for (int d = 0; d < 3; ++d) {
+                clip_box[d] = (clip_lo[d] - loader->dims[d]/2 - 0.5f) * geometry_scale;
+                clip_box[d + 3] = (clip_hi[d] - loader->dims[d]/2 + 0.5f) * geometry_scale;
+            }
+            for (auto &l : loaders)
+                l.second->rebuildClipped(clip_box);
+            unclipped_slice = shown_slice;
+        }
+        if (slice_index >= 0 && loader->ready && slice_axis != volumeAxis) {
+            ImGui::Begin("Slice");
+            ImGui::RadioButton("x", &slice_axis, 0);
+            ImGui::SameLine();
+            ImGui::RadioButton("y", &slice_axis, 1);
+            ImGui::SameLine();
+            ImGui::RadioButton("z", &slice_axis, 2);
+            if (slice_axis != shown_axis)
+                slice_index = loader->dims[slice_axis] / 2;
+            ImGui::SliderInt("Slice", &slice_index, 0, loader->dims[slice_axis] - 1);
+            ImGui::End();
+        }
+        if (!shown_slice || !shown_slice->done) {
+            const size_t loaded = shown_slice ? size_t(shown_slice->glyphs_loaded) : 0;
+            const size_t total = shown_slice ? size_t(shown_slice->glyphs_total) : 0;
+            ImGui::Begin("Loading");
+            ImGui::ProgressBar(total > 0 ? float(loaded) / total : 0.f);
+            ImGui::Text("%zu / %zu glyphs", loaded, total);
+            ImGui::End();
+        }
+        #endif
+
+        if (show_perf && history.size() > 0) {
+            const FrameStats &last = history.back();
+            const std::vector<float> recent = history.recent_render_ms(perfFramesShown);
+            ImGui::Begin("Performance");
+            ImGui::PlotLines("Render (ms)",
+                             recent.data(),
+                             int(recent.size()),
+                             0,
+                             nullptr,
+                             0.f,
+                             FLT_MAX,
+                             ImVec2(0, 80));
+            ImGui::Text("p50 %.1fms  p95 %.1fms  p99 %.1fms over %zu frames",
+                        history.render_percentile_ms(50.f, perfFramesShown),
+                        history.render_percentile_ms(95.f, perfFramesShown),
+                        history.render_percentile_ms(99.f, perfFramesShown),
+                        recent.size());
+            ImGui::Text("%dx%d, %zu samples per pixel, variance %.4f",
+                        last.width,
+                        last.height,
+                        last.samples,
+                        last.variance);
+            ImGui::Text("%s, CPU %.0f%% of a core",
+                        render_converged ? "converged" : "rendering",
+                        cpu_percent);
+            // One sample per pixel per frame
+            const double rays = double(last.width) * last.height;
+            ImGui::Text("%.1f Mrays/s (primary)",
+                        last.render_seconds > 0.f ? rays / last.render_seconds * 1e-6 : 0.0);
+            ImGui::Text("commit %.2fms  render %.2fms  map %.2fms  upload %.2fms",
+                        last.commit_seconds * 1000.f,
+                        last.render_seconds * 1000.f,
+                        last.map_seconds * 1000.f,
+                        last.upload_seconds * 1000.f);
+            if (input_latency_ms >= 0.f)
+                ImGui::Text("input to pixels %.1fms", input_latency_ms);
+            if (denoiser_available && ImGui::Checkbox("Denoise", &denoise_ui)) {
+                const bool on = denoise_ui;
+                update.changes.push_back([&, on]() {
+                    denoising = on;
+                    fb = makeFrameBuffer(fb_width, fb_height, true);
+                    clearAccumulation();
+                    reduced_width = 0;
+                });
+            }
+            for (int d = 0; d < 2; ++d) {
+                if (settled[d].views > 0)
+                    ImGui::Text("%s settled after %zu samples, %.0fms",
+                                d ? "denoised" : "raw",
+                                settled[d].samples,
+                                settled[d].seconds * 1000.f);
+            }
+            if (settled[0].views > 0 && settled[1].views > 0)
+                ImGui::Text("denoising saves %.0fms",
+                            (settled[0].seconds - settled[1].seconds) * 1000.f);
+            #if renderSH
+            // Each glyph is a single primitive of its batch's geometry
+            ImGui::Text("%zu glyphs (primitives) in %zu instances",
+                        shown_glyphs,
+                        instances.size());
+            #endif
+            if (ImGui::Button("Save CSV")) {
+                std::ofstream csv_out("frame_stats.csv");
+                history.write_csv(csv_out);
+                std::cout << "Frame stats saved to 'frame_stats.csv'" << std::endl;
+            }
+            ImGui::End();
+        }
+
+        #if renderSH
+        if (clip_changed && !clip_rebuild) {
+            // Only the culling in the kernels changes, nothing is committed.
+            // Done between frames so none sees half a box.
+            clip_changed = false;
+            std::array<float, 6> box;
+            for (int d = 0; d < 3; ++d) {
+                box[d] = (clip_lo[d] - loader->dims[d]/2 - 0.5f) * geometry_scale;
+                box[d + 3] = (clip_hi[d] - loader->dims[d]/2 + 0.5f) * geometry_scale;
+            }
+            update.changes.push_back([&, box]() {
+                std::copy(box.begin(), box.end(), clip_box);
+                clearAccumulation();
+            });
+        }
+
+        tags.had_glyphs = !instances.empty();
+        tags.had_all_glyphs = shown_slice && shown_slice->done
+            && loader->batchesSince(*shown_slice, published).empty();
+        tags.clipped = clip_pending && tags.had_all_glyphs && shown_slice != unclipped_slice;
+        #endif
+        tags.inputs = inputs;
+
+        // Send this pass's changes in one go, so no frame shows part of them.
+        // If the queue is full they are merged into the update still unsent
+        // and go with the next pass's, the changes keep their order.
+        if (!update.changes.empty() || tags != sent_tags || unsent_pending) {
+            unsent.changes.insert(unsent.changes.end(),
+                                  std::make_move_iterator(update.changes.begin()),
+                                  std::make_move_iterator(update.changes.end()));
+            unsent.tags = tags;
+            unsent.cancel_frame |= camera_changed || window_changed;
+            // Replayed frames are all rendered at full resolution
+            unsent.interacting |= camera_changed && replay.empty();
+            unsent_pending = !render_updates.push(std::move(unsent));
+            if (!unsent_pending) {
+                unsent = RenderUpdate();
+                {
+                    std::lock_guard<std::mutex> lock(render_wake_mutex);
+                    update_queued = true;
+                    render_wake.notify_one();
+                }
+                ++updates_sent;
+            }
+            sent_tags = tags;
+        }
+
+        #if renderSH
+        // Loaders retired in this pass may back the glyphs of the slice just
+        // swapped out, so they go once the world is committed without it and
+        // they have stopped
+        for (auto &l : retiring)
+            retired.emplace_back(updates_sent + (unsent_pending ? 1 : 0), std::move(l));
+        retiring.clear();
+        const size_t applied = updates_applied.load(std::memory_order_acquire);
+        retired.erase(
+            std::remove_if(retired.begin(),
+                           retired.end(),
+                           [&](const std::pair<size_t, std::unique_ptr<GlyphLoader>> &l) {
+                               return l.first <= applied && l.second->done;
+                           }),
+            retired.end());
+        #endif
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now - cpu_sampled >= std::chrono::seconds(1)) {
+            const double cpu = process_cpu_seconds();
+            cpu_percent = 100.0 * (cpu - cpu_seconds)
+                / std::chrono::duration<double>(now - cpu_sampled).count();
+            cpu_seconds = cpu;
+            cpu_sampled = now;
+        }
+
         // Rendering
         ImGui::Render();
         glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
 
-        if (future.isReady()) {
-            if (!window_changed) {
-                uint32_t *img = (uint32_t *)fb.map(OSP_FB_COLOR);
-                glTexSubImage2D(GL_TEXTURE_2D,
-                                0,
-                                0,
-                                0,
-                                win_width,
-                                win_height,
-                                GL_RGBA,
-                                GL_UNSIGNED_BYTE,
-                                img);
-                if (take_screenshot) {
-                    take_screenshot = false;
-                    stbi_flip_vertically_on_write(1);
-                    stbi_write_png(
-                        "screenshot.png", win_width, win_height, 4, img, win_width * 4);
-                    std::cout << "Screenshot saved to 'screenshot.png'" << std::endl;
-                    stbi_flip_vertically_on_write(0);
+        if (rendered_frames.update()) {
+            RenderedFrame &frame = rendered_frames.read_slot();
+            if (frame.width != render_texture.width || frame.height != render_texture.height)
+                render_texture.resize(frame.width, frame.height);
+            const auto upload_start = std::chrono::steady_clock::now();
+            if (frame.in_mapped)
+                render_texture.upload(frame.mapped);
+            else
+                render_texture.upload(frame.pixels.data());
+            // The slot goes back to the render thread with a buffer mapped
+            // for a later frame
+            render_texture.map(frame.mapped, size_t(win_width) * win_height);
+            // Frames the UI skipped were never uploaded
+            frame.stats.back().upload_seconds = std::chrono::duration<float>(
+                std::chrono::steady_clock::now() - upload_start).count();
+            for (const auto &stats : frame.stats)
+                history.add(stats);
+            if (take_screenshot) {
+                take_screenshot = false;
+                const std::vector<uint32_t> pixels = render_texture.read();
+                stbi_flip_vertically_on_write(1);
+                stbi_write_png("screenshot.png",
+                               frame.width,
+                               frame.height,
+                               4,
+                               pixels.data(),
+                               frame.width * 4);
+                std::cout << "Screenshot saved to 'screenshot.png'" << std::endl;
+                stbi_flip_vertically_on_write(0);
+            }
+            if (replay_waiting && frame.tags.inputs >= replay_inputs) {
+                replay_waiting = false;
+                replay_history.add(frame.stats.back());
+                if (++replay_frame == replay_total) {
+                    std::ofstream csv_out(replay_csv_file);
+                    replay_history.write_csv(csv_out);
+                    std::cout << "Replayed " << replay_total << " frames, render p50 "
+                              << replay_history.render_percentile_ms(50.f, replay_total)
+                              << "ms p95 "
+                              << replay_history.render_percentile_ms(95.f, replay_total)
+                              << "ms p99 "
+                              << replay_history.render_percentile_ms(99.f, replay_total)
+                              << "ms, timing saved to '" << replay_csv_file << "'\n";
+                    done = true;
                 }
-                fb.unmap(img);
             }
-            window_changed = false;
-
-            if (!pending_commits.empty()) {
-                fb.clear();
+            render_converged = frame.converged;
+            if (frame.quality.views != quality_views) {
+                quality_views = frame.quality.views;
+                settled[frame.quality.denoised] = frame.quality;
             }
-            for (auto &c : pending_commits) {
-                ospCommit(c);
+            if (input_waiting && frame.tags.inputs >= waiting_input) {
+                // The texture is drawn and swapped in below
+                input_waiting = false;
+                input_latency_ms = std::chrono::duration<float, std::milli>(
+                    std::chrono::steady_clock::now() - input_time).count();
             }
-            pending_commits.clear();
-
-            struct timeval t1, t2;
-            double elapsedTime;
 
-            // start timer
-            future = fb.renderFrame(renderer, camera, world);
-            future.wait();
-            frameTime[frameIndex++] = future.duration();
-            if (frameIndex >= framesAveraged)
-                frameIndex = 0;
-            float totalFrameTime = 0.f;
-            for (int i = 0; i < std::min(framesAveraged, ++framesRecorded); ++i)
-                totalFrameTime += frameTime[i];
-            float avgTime = totalFrameTime / std::min(framesAveraged, framesRecorded);
-            std::cout << "fps: " << 1.0/avgTime << std::endl;
+            startup_timer.mark("first frame");
+            if (frame.tags.had_glyphs)
+                startup_timer.mark("first glyphs drawn");
+            #if renderSH
+            if (frame.tags.clipped && clip_pending) {
+                // From moving the clip box to a frame with all glyphs
+                // clipped, to compare culling with rebuilding the BVH
+                clip_pending = false;
+                unclipped_slice.reset();
+                const double seconds = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - clip_moved).count();
+                startup_timer.add(clip_rebuild ? "clip rebuild" : "clip cull", seconds);
+                std::cout << "Clip box update (" << (clip_rebuild ? "rebuild" : "cull")
+                          << "): " << seconds * 1000.0 << "ms\n";
+            }
+            #endif
+            if (report_timing && frame.tags.had_all_glyphs
+                && !startup_timer.has_mark("all glyphs drawn")) {
+                startup_timer.mark("all glyphs drawn");
+                std::cout << "Startup timing:\n";
+                startup_timer.print(std::cout);
+                if (!timing_json_file.empty()) {
+                    std::ofstream json_out(timing_json_file);
+                    json_out << startup_timer.to_json().dump(4) << "\n";
+                    std::cout << "Startup timing written to " << timing_json_file << "\n";
+                }
+            }
         }
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glUseProgram(display_render.program);
+        display_render.uniform("display_size", glm::vec2(io.DisplaySize.x, io.DisplaySize.y));
+        glBindTexture(GL_TEXTURE_2D, render_texture.texture);
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
         SDL_GL_SwapWindow(window);
 
+        // ImGui takes a pass or two after input to settle hover and
+        // active states
+        quiet_passes = had_input ? 0 : quiet_passes + 1;
+        idle = quiet_passes >= 2 && !camera_changed && !window_changed
+            && tags.had_all_glyphs && replay_frame >= replay_total
+            && !unsent_pending && updates_applied == updates_sent && render_idle;
+
         camera_changed = false;
+        window_changed = false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(render_wake_mutex);
+        render_quit = true;
+        render_wake.notify_one();
     }
+    render_thread.join();
 }
@@ -18,10 +18,16 @@ struct Ellipsoids {
     float global_radius;
     Data1D eigvec1;
     Data1D eigvec2;
-    affine3f basis;
-    affine3f inv_basis;
+    // optional 6-float symmetric tensor (xx, xy, xz, yy, yz, zz) per glyph,
+    // the glyph surface is then x^T D^-1 x = 1 and radii/eigvecs are unused
+    Data1D tensor;
+    // per-glyph world-to-unit-sphere transforms and their normal matrices,
+    // precomputed on commit so the intersect kernel only reads them. Null
+    // with a tensor, so only the radii/eigvecs path may read them.
+    affine3f *invXfm;
+    linear3f *normalXfm;
 #ifdef __cplusplus
-    Ellipsoids() {}
+    Ellipsoids() : invXfm(nullptr), normalXfm(nullptr) {}
 };
 } // namespace ispc
 #else
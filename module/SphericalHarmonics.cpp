@@ -7,12 +7,21 @@
 #include "common/Data.h"
 #include "common/World.h"
 #include "camera/PerspectiveCamera.h"
+#include "rkcommon/tasking/parallel_for.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 // ispc-generated files
 #include "spherical_harmonics_ispc.h"
 
 namespace ospray {
 namespace tensor_geometry {
 
+    const static size_t coefficientCount = 15;
+    // Glyphs per task when precomputing AABBs
+    const static size_t aabbBlockSize = 256;
+
     SphericalHarmonics::SphericalHarmonics()
     {
         getSh()->super.postIntersect = ispc::SphericalHarmonics_postIntersect_addr();
@@ -33,10 +42,26 @@ namespace tensor_geometry {
         }
         vertexData = getParamDataT<vec3f>("glyph.position", true);
         boundRadiusData = getParamDataT<float>("glyph.boundRadius");
-        coefficientData = getParamDataT<float>("glyph.coefficients");
+        coefficientData = getParamDataT<float>("glyph.coefficients", true);
         rotatedCoefficientData = getParamDataT<float>("glyph.rotatedCoefficients");
+        clipBoxData = getParamDataT<float>("glyph.clipBox");
+        if (clipBoxData && clipBoxData->size() != 6) {
+            throw std::runtime_error(toString() + ": 'glyph.clipBox' must have 6 items");
+        }
         shRenderMethod = (SHRenderMethod)getParam<uint>("glyph.shRenderMethod");
         useCylinder = getParam<bool>("glyph.useCylinder");
+        shScale = getParam<float>("glyph.shScale", 1.f);
+        sh0Scale = getParam<float>("glyph.sh0Scale", 1.f);
+        aabbData = getParamDataT<vec3f>("glyph.aabbs");
+        aabbValidData = getParamDataT<uint8_t>("glyph.aabbsValid");
+        if (aabbData && (aabbData->size() != numPrimitives() || !aabbData->compact())) {
+            throw std::runtime_error(
+                toString() + ": 'glyph.aabbs' must be compact with one item per glyph");
+        }
+        if (aabbValidData && (!aabbData || aabbValidData->size() != numPrimitives())) {
+            throw std::runtime_error(
+                toString() + ": 'glyph.aabbsValid' needs 'glyph.aabbs' and one item per glyph");
+        }
         auto cam = (PerspectiveCamera*)getParamObject("glyph.camera");
 
         createEmbreeUserGeometry((RTCBoundsFunction)&ispc::SphericalHarmonics_bounds,
@@ -44,13 +69,71 @@ namespace tensor_geometry {
                                  (RTCOccludedFunctionN)&ispc::SphericalHarmonics_occluded);
         getSh()->vertex = *ispc(vertexData);
         getSh()->coefficients = *ispc(coefficientData);
+        // Either 15 floats per glyph, or one item per glyph whose stride
+        // steps over whole records and whose first 15 floats are used
+        const int64 byteStride = ispc(coefficientData)->byteStride;
+        if (coefficientData->size() == numPrimitives()) {
+            getSh()->coefficientStride = byteStride;
+        } else if (coefficientData->size() == coefficientCount * numPrimitives()) {
+            getSh()->coefficientStride = coefficientCount * byteStride;
+        } else {
+            throw std::runtime_error(toString()
+                                     + ": 'glyph.coefficients' must have 1 or 15 items per glyph");
+        }
+        getSh()->shScale = shScale;
+        getSh()->sh0Scale = sh0Scale;
         getSh()->rotatedCoefficients = *ispc(rotatedCoefficientData);
         getSh()->boundRadius = *ispc(boundRadiusData);
+        // Not copied, the kernels see updates to the shared data as they
+        // happen
+        getSh()->clipBox = clipBoxData ? clipBoxData->data() : nullptr;
         if (cam) getSh()->camera = cam->getSh();
         getSh()->super.numPrimitives = numPrimitives();
         getSh()->shRenderMethod = shRenderMethod;
         getSh()->useCylinder = useCylinder;
 
+        // The Newton AABB search dominates BVH builds, so run it once here
+        // in parallel instead of inside the serial bounds callback. AABBs
+        // the app already has are not searched again.
+        getSh()->aabbs = nullptr;
+        if (!useCylinder) {
+            // Reported for the viewer's startup timing, see -timing
+            auto start = std::chrono::steady_clock::now();
+            vec3f *out = nullptr;
+            if (aabbData) {
+                out = const_cast<vec3f *>(aabbData->data());
+            } else {
+                aabbs.resize(numPrimitives());
+                out = aabbs.data();
+            }
+            const uint8_t *valid = aabbValidData ? aabbValidData->data() : nullptr;
+            std::atomic<size_t> computed{0};
+            const size_t count = numPrimitives();
+            const size_t numBlocks = (count + aabbBlockSize - 1) / aabbBlockSize;
+            tasking::parallel_for(numBlocks, [&](size_t b) {
+                const size_t end = std::min(count, (b + 1) * aabbBlockSize);
+                // Each run of glyphs without a valid AABB in one call
+                for (size_t i = b * aabbBlockSize; i < end;) {
+                    if (valid && valid[i]) {
+                        ++i;
+                        continue;
+                    }
+                    size_t runEnd = i + 1;
+                    while (runEnd < end && !(valid && valid[runEnd]))
+                        ++runEnd;
+                    ispc::SphericalHarmonics_computeAABBs(getSh(), (float *)out, i, runEnd);
+                    computed += runEnd - i;
+                    i = runEnd;
+                }
+            });
+            getSh()->aabbs = out;
+            postStatusMsg(OSP_LOG_INFO)
+                << "[timing] AABB precompute: "
+                << std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+                       .count()
+                << " (" << computed << " of " << count << " glyphs)";
+        }
+
         postCreationInfo();
         ispc::SphericalHarmonics_tests();
     }
@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
 #include "geometry/Geometry.h"
 // ispc shared
 #include "SphericalHarmonicsShared.h"
@@ -26,7 +28,15 @@ namespace tensor_geometry {
         Ref<const DataT<float>> boundRadiusData;
         Ref<const DataT<float>> coefficientData;
         Ref<const DataT<float>> rotatedCoefficientData;
+        Ref<const DataT<float>> clipBoxData;
         SHRenderMethod shRenderMethod{SHRenderMethod::NewtonBisection};
         bool useCylinder;
+        float shScale{1.f};
+        float sh0Scale{1.f};
+        // Given by the app to keep AABBs across commits, holding those
+        // flagged in aabbValidData and receiving the rest
+        Ref<const DataT<vec3f>> aabbData;
+        Ref<const DataT<uint8_t>> aabbValidData;
+        std::vector<vec3f> aabbs;
     };
 }}
@@ -16,14 +16,33 @@ struct SphericalHarmonics {
     Geometry super;
     Data1D vertex;
     Data1D coefficients;
+    // bytes between the first coefficients of consecutive glyphs, which lets
+    // coefficients be a strided view into a larger per-voxel record
+    int64 coefficientStride;
+    // applied when coefficients are read, so shared data is never modified
+    float shScale;
+    float sh0Scale;
     Data1D rotatedCoefficients;
     Data1D boundRadius;
+    // per-glyph AABB half extents, precomputed or loaded on commit
+    vec3f *aabbs;
+    // optional box (lower xyz, upper xyz) outside of which glyph centers are
+    // culled. Read on every intersection from shared data, so the app can
+    // move it without a commit or BVH build.
+    float *clipBox;
     PerspectiveCamera* camera;
     SHRenderMethod shRenderMethod;
     bool useCylinder;
 
 #ifdef __cplusplus
-  SphericalHarmonics() : shRenderMethod(SHRenderMethod::NewtonBisection) {}
+  SphericalHarmonics()
+      : coefficientStride(0),
+        shScale(1.f),
+        sh0Scale(1.f),
+        aabbs(nullptr),
+        clipBox(nullptr),
+        shRenderMethod(SHRenderMethod::NewtonBisection)
+  {}
 };
 } // namespace ispc
 #else
@@ -5,6 +5,7 @@
 #include "ellipsoid.h"
 #include "common/Data.h"
 #include "common/World.h"
+#include "rkcommon/tasking/parallel_for.h"
 // ispc-generated files
 #include "ellipsoid_ispc.h"
 
@@ -25,9 +26,33 @@ namespace tensor_geometry {
     void Ellipsoids::commit()
     {
         vertexData = getParamDataT<vec3f>("glyph.position", true);
-        radiiData = getParamDataT<vec3f>("glyph.radii");
-        eigvec1Data = getParamDataT<vec3f>("glyph.eigvec1");
-        eigvec2Data = getParamDataT<vec3f>("glyph.eigvec2");
+        tensorData = getParamDataT<float>("glyph.tensor");
+        radiiData = getParamDataT<vec3f>("glyph.radii", !tensorData);
+        eigvec1Data = getParamDataT<vec3f>("glyph.eigvec1", !tensorData);
+        eigvec2Data = getParamDataT<vec3f>("glyph.eigvec2", !tensorData);
+
+        const size_t numGlyphs = numPrimitives();
+        if (tensorData && tensorData->size() != 6 * numGlyphs) {
+            throw std::runtime_error(toString()
+                                     + ": 'glyph.tensor' needs 6 floats per glyph position");
+        }
+
+        // Build the unit-sphere frame of every glyph once, instead of
+        // inverting it per ray inside the intersect kernel. The tensor
+        // path intersects the quadric form directly and needs no frame.
+        invXfm.resize(tensorData ? 0 : numGlyphs);
+        normalXfm.resize(tensorData ? 0 : numGlyphs);
+        tasking::parallel_for(invXfm.size(), [&](size_t i) {
+            const vec3f radii = (*radiiData)[i];
+            const vec3f eigvec1 = (*eigvec1Data)[i];
+            const vec3f eigvec2 = (*eigvec2Data)[i];
+            const vec3f eigvec3 = cross(eigvec1, eigvec2);
+            const affine3f basis(
+                linear3f(radii.x * eigvec1, radii.y * eigvec2, radii.z * eigvec3),
+                (*vertexData)[i]);
+            invXfm[i] = rcp(basis);
+            normalXfm[i] = invXfm[i].l.transposed();
+        });
 
         createEmbreeUserGeometry((RTCBoundsFunction)&ispc::Ellipsoids_bounds,
                                  (RTCIntersectFunctionN)&ispc::Ellipsoids_intersect,
@@ -36,6 +61,9 @@ namespace tensor_geometry {
         getSh()->radii = *ispc(radiiData);
         getSh()->eigvec1 = *ispc(eigvec1Data);
         getSh()->eigvec2 = *ispc(eigvec2Data);
+        getSh()->tensor = *ispc(tensorData);
+        getSh()->invXfm = tensorData ? nullptr : invXfm.data();
+        getSh()->normalXfm = tensorData ? nullptr : normalXfm.data();
 
         postCreationInfo();
     }
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <vector>
 #include "geometry/Geometry.h"
 // c++ shared
 #include "EllipsoidsShared.h"
@@ -29,5 +30,8 @@ namespace tensor_geometry {
         Ref<const DataT<vec2f>> texcoordData;
         Ref<const DataT<vec3f>> eigvec1Data;
         Ref<const DataT<vec3f>> eigvec2Data;
+        Ref<const DataT<float>> tensorData;
+        std::vector<affine3f> invXfm;
+        std::vector<linear3f> normalXfm;
     };
 }}
@@ -33,6 +33,14 @@ ArcballCamera::ArcballCamera(const glm::vec3 &eye,
     update_camera();
 }
 
+ArcballCamera::ArcballCamera(const glm::vec3 &center, float distance, const glm::quat &rotation)
+    : center_translation(glm::inverse(glm::translate(center))),
+      translation(glm::translate(glm::vec3(0.f, 0.f, -distance))),
+      rotation(glm::normalize(rotation))
+{
+    update_camera();
+}
+
 void ArcballCamera::rotate(glm::vec2 prev_mouse, glm::vec2 cur_mouse)
 {
     // Clamp mouse positions to stay in NDC
@@ -90,6 +98,21 @@ glm::vec3 ArcballCamera::up() const
     return glm::normalize(glm::vec3{inv_camera * glm::vec4{0, 1, 0, 0}});
 }
 
+glm::vec3 ArcballCamera::center() const
+{
+    return -glm::vec3(center_translation[3]);
+}
+
+float ArcballCamera::distance() const
+{
+    return -translation[3][2];
+}
+
+const glm::quat &ArcballCamera::orientation() const
+{
+    return rotation;
+}
+
 void ArcballCamera::update_camera()
 {
     camera = translation * glm::mat4_cast(rotation) * center_translation;
@@ -26,6 +26,11 @@ public:
 
     ArcballCamera(const glm::mat4 &mat);
 
+    /* Create an arcball camera from its components, distance away from the
+     * center and rotated about it
+     */
+    ArcballCamera(const glm::vec3 &center, float distance, const glm::quat &rotation);
+
     /* Rotate the camera from the previous mouse position to the current
      * one. Mouse positions should be in normalized device coordinates
      */
@@ -56,6 +61,15 @@ public:
     // Get the up direction of the camera in world space
     glm::vec3 up() const;
 
+    // Get the point the camera rotates around
+    glm::vec3 center() const;
+
+    // Get the distance of the eye from the center
+    float distance() const;
+
+    // Get the rotation of the camera about the center
+    const glm::quat &orientation() const;
+
 private:
     void update_camera();
 };
@@ -0,0 +1,206 @@
+#include "brick_cache.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+const static char brick_magic[8] = {'S', 'H', 'B', 'R', 'I', 'C', 'K', '3'};
+
+size_t BrickInfo::num_voxels() const
+{
+    return size_t(hi[0] - lo[0]) * (hi[1] - lo[1]) * (hi[2] - lo[2]);
+}
+
+void write_bricked_volume(const SHVolume &volume, const std::string &fname, int brick_size)
+{
+    const size_t coeff_count = SHCoeffView::coeff_count;
+    BrickFileHeader header;
+    std::memcpy(header.magic, brick_magic, sizeof(brick_magic));
+    header.brick_size = brick_size;
+    header.padding = 0;
+    for (int i = 0; i < 3; ++i) {
+        header.dims[i] = volume.header.dims[i];
+        header.n_bricks[i] = (header.dims[i] + brick_size - 1) / brick_size;
+    }
+    const size_t bricks_per_layer = size_t(header.n_bricks[0]) * header.n_bricks[1];
+    std::vector<BrickInfo> index(bricks_per_layer * header.n_bricks[2]);
+
+    std::ofstream out(fname, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error("Failed to open file: " + fname);
+    }
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    // The index is filled in once all brick offsets are known
+    const uint64_t index_offset = out.tellp();
+    out.write(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(BrickInfo));
+    uint64_t offset = out.tellp();
+
+    // Gather one layer of bricks in parallel, then append them in order, so
+    // only a layer is ever held in memory
+    std::vector<std::vector<float>> layer(bricks_per_layer);
+    for (int bz = 0; bz < header.n_bricks[2]; ++bz) {
+        tbb::parallel_for(size_t(0), bricks_per_layer, [&](size_t b) {
+            BrickInfo &info = index[bz * bricks_per_layer + b];
+            const int brick[3] = {int(b % header.n_bricks[0]), int(b / header.n_bricks[0]), bz};
+            for (int i = 0; i < 3; ++i) {
+                info.lo[i] = brick[i] * brick_size;
+                info.hi[i] = std::min(info.lo[i] + brick_size, header.dims[i]);
+            }
+            info.max_radius = 0.f;
+            info.padding = 0.f;
+
+            std::vector<float> &data = layer[b];
+            data.resize(info.num_voxels() * coeff_count);
+            if (volume.payload) {
+                read_glyph_major_box(
+                    volume.payload, volume.header, info.lo, info.hi, data.data());
+            } else {
+                float *dst = data.data();
+                SHCoeffView unscaled = volume.coeffs;
+                unscaled.scale = unscaled.scale_0 = 1.f;
+                for (int z = info.lo[2]; z < info.hi[2]; ++z) {
+                    for (int y = info.lo[1]; y < info.hi[1]; ++y) {
+                        for (int x = info.lo[0]; x < info.hi[0]; ++x) {
+                            const size_t voxel =
+                                (size_t(z) * header.dims[1] + y) * header.dims[0] + x;
+                            unscaled.get(voxel, dst);
+                            dst += coeff_count;
+                        }
+                    }
+                }
+            }
+            for (size_t v = 0; v < info.num_voxels(); ++v) {
+                info.max_radius =
+                    std::max(info.max_radius, sh_bound_radius(&data[v * coeff_count]));
+            }
+        });
+        for (size_t b = 0; b < bricks_per_layer; ++b) {
+            index[bz * bricks_per_layer + b].offset = offset;
+            out.write(reinterpret_cast<const char *>(layer[b].data()),
+                      layer[b].size() * sizeof(float));
+            offset += layer[b].size() * sizeof(float);
+        }
+    }
+
+    out.seekp(index_offset);
+    out.write(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(BrickInfo));
+    if (!out.good()) {
+        throw std::runtime_error("Failed to write bricked volume: " + fname);
+    }
+}
+
+BrickCache::BrickCache(const std::string &fname, size_t budget_bytes)
+    : file(fname, std::ios::binary), budget_bytes(budget_bytes)
+{
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file: " + fname);
+    }
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!file.good() || std::memcmp(header.magic, brick_magic, sizeof(brick_magic)) != 0) {
+        throw std::runtime_error(fname + ": not a bricked SH volume");
+    }
+    index.resize(size_t(header.n_bricks[0]) * header.n_bricks[1] * header.n_bricks[2]);
+    file.read(reinterpret_cast<char *>(index.data()), index.size() * sizeof(BrickInfo));
+    if (!file.good()) {
+        throw std::runtime_error(fname + ": truncated brick index");
+    }
+}
+
+const int32_t *BrickCache::dims() const
+{
+    return header.dims;
+}
+
+size_t BrickCache::num_bricks() const
+{
+    return index.size();
+}
+
+const BrickInfo &BrickCache::brick_info(size_t i) const
+{
+    return index[i];
+}
+
+std::vector<size_t> BrickCache::bricks_in_box(const int lo[3], const int hi[3]) const
+{
+    int b_lo[3], b_hi[3];
+    for (int i = 0; i < 3; ++i) {
+        b_lo[i] = std::max(lo[i], 0) / header.brick_size;
+        b_hi[i] = std::min((std::min(hi[i], header.dims[i]) + header.brick_size - 1)
+                               / header.brick_size,
+                           header.n_bricks[i]);
+    }
+    std::vector<size_t> bricks;
+    for (int z = b_lo[2]; z < b_hi[2]; ++z) {
+        for (int y = b_lo[1]; y < b_hi[1]; ++y) {
+            for (int x = b_lo[0]; x < b_hi[0]; ++x) {
+                bricks.push_back((size_t(z) * header.n_bricks[1] + y) * header.n_bricks[0] + x);
+            }
+        }
+    }
+    return bricks;
+}
+
+BrickCache::Brick BrickCache::load(size_t i)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto fnd = resident.find(i);
+    if (fnd != resident.end()) {
+        lru.splice(lru.begin(), lru, fnd->second.second);
+        return fnd->second.first;
+    }
+
+    const BrickInfo &info = index[i];
+    auto data = std::make_shared<std::vector<float>>(info.num_voxels()
+                                                     * SHCoeffView::coeff_count);
+    file.seekg(info.offset);
+    file.read(reinterpret_cast<char *>(data->data()), data->size() * sizeof(float));
+    if (!file.good()) {
+        throw std::runtime_error("Failed to read brick " + std::to_string(i));
+    }
+
+    lru.push_front(i);
+    resident[i] = std::make_pair(data, lru.begin());
+    resident_bytes += data->size() * sizeof(float);
+    // Evict least recently used bricks, but never the one just loaded
+    while (resident_bytes > budget_bytes && lru.size() > 1) {
+        auto evict = resident.find(lru.back());
+        resident_bytes -= evict->second.first->size() * sizeof(float);
+        resident.erase(evict);
+        lru.pop_back();
+    }
+    return data;
+}
+
+std::vector<float> BrickCache::read_box(const int lo[3], const int hi[3])
+{
+    const size_t coeff_count = SHCoeffView::coeff_count;
+    const size_t w = hi[0] - lo[0];
+    const size_t h = hi[1] - lo[1];
+    std::vector<float> box(w * h * (hi[2] - lo[2]) * coeff_count);
+    for (size_t b : bricks_in_box(lo, hi)) {
+        const BrickInfo &info = index[b];
+        Brick brick = load(b);
+        const int bw = info.hi[0] - info.lo[0];
+        const int bh = info.hi[1] - info.lo[1];
+        // Where the brick and the box overlap
+        int o_lo[3], o_hi[3];
+        for (int i = 0; i < 3; ++i) {
+            o_lo[i] = std::max(lo[i], info.lo[i]);
+            o_hi[i] = std::min(hi[i], info.hi[i]);
+        }
+        const size_t row_floats = size_t(o_hi[0] - o_lo[0]) * coeff_count;
+        for (int z = o_lo[2]; z < o_hi[2]; ++z) {
+            for (int y = o_lo[1]; y < o_hi[1]; ++y) {
+                const float *src = brick->data()
+                    + ((size_t(z - info.lo[2]) * bh + y - info.lo[1]) * bw + o_lo[0] - info.lo[0])
+                        * coeff_count;
+                float *dst = box.data()
+                    + ((size_t(z - lo[2]) * h + y - lo[1]) * w + o_lo[0] - lo[0]) * coeff_count;
+                std::memcpy(dst, src, row_floats * sizeof(float));
+            }
+        }
+    }
+    return box;
+}
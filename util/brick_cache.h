@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "nrrd.h"
+
+/* Bricked SH volumes: the volume split into bricks of brick_size^3 voxels,
+ * each stored glyph-major (x fastest) with 15 coefficients per voxel. A
+ * brick index with the payload offset, voxel bounds and largest glyph radius
+ * of every brick follows the file header, so a viewer can decide which
+ * bricks it needs without touching the payload.
+ */
+struct BrickFileHeader {
+    char magic[8];
+    int32_t dims[3];
+    int32_t brick_size;
+    int32_t n_bricks[3];
+    int32_t padding;
+};
+
+struct BrickInfo {
+    // Byte offset of the brick payload in the file
+    uint64_t offset;
+    // Voxel range [lo, hi) covered by the brick
+    int32_t lo[3];
+    int32_t hi[3];
+    // Largest bound radius of the unscaled glyphs in the brick
+    float max_radius;
+    float padding;
+
+    size_t num_voxels() const;
+};
+
+/* Convert the volume to a bricked file, a layer of bricks at a time. A volume
+ * mapped without converting it is read brick by brick from its payload, so
+ * only the layer is held in memory.
+ */
+void write_bricked_volume(const SHVolume &volume,
+                          const std::string &fname,
+                          int brick_size = 32);
+
+/* Pages bricks of a bricked volume in on demand, keeping the most recently
+ * used ones resident up to a memory budget. Bricks still referenced by the
+ * caller stay alive even when evicted from the cache.
+ */
+class BrickCache {
+    BrickFileHeader header;
+    std::vector<BrickInfo> index;
+    std::ifstream file;
+    size_t budget_bytes;
+    size_t resident_bytes = 0;
+
+    using Brick = std::shared_ptr<const std::vector<float>>;
+    // Most recently used at the front
+    std::list<size_t> lru;
+    std::unordered_map<size_t, std::pair<Brick, std::list<size_t>::iterator>> resident;
+    std::mutex mutex;
+
+    // The bricks overlapping the voxel range [lo, hi)
+    std::vector<size_t> bricks_in_box(const int lo[3], const int hi[3]) const;
+
+public:
+    BrickCache(const std::string &fname, size_t budget_bytes);
+
+    const int32_t *dims() const;
+
+    size_t num_bricks() const;
+
+    const BrickInfo &brick_info(size_t i) const;
+
+    // Get the coefficients of brick i, reading it from disk if needed
+    Brick load(size_t i);
+
+    // Gather the voxel range [lo, hi) into 15 coefficients per voxel with x
+    // fastest, paging in only the bricks it crosses
+    std::vector<float> read_box(const int lo[3], const int hi[3]);
+};
@@ -0,0 +1,60 @@
+#include "camera_path.h"
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+CameraKeyframe::CameraKeyframe(double seconds, const ArcballCamera &camera)
+    : seconds(seconds), camera(camera)
+{
+}
+
+ArcballCamera interpolate_camera(const ArcballCamera &a, const ArcballCamera &b, float t)
+{
+    // glm::slerp takes the short way around, whatever the signs of the
+    // quaternions
+    return ArcballCamera(glm::mix(a.center(), b.center(), t),
+                         glm::mix(a.distance(), b.distance(), t),
+                         glm::slerp(a.orientation(), b.orientation(), t));
+}
+
+void write_camera_path(const std::string &fname, const std::vector<CameraKeyframe> &path)
+{
+    std::ofstream out(fname);
+    if (!out.is_open()) {
+        throw std::runtime_error("Failed to open file: " + fname);
+    }
+    out << std::setprecision(9);
+    for (const auto &k : path) {
+        const glm::vec3 c = k.camera.center();
+        const glm::quat &r = k.camera.orientation();
+        out << k.seconds << " " << c.x << " " << c.y << " " << c.z << " "
+            << k.camera.distance() << " " << r.w << " " << r.x << " " << r.y << " " << r.z
+            << "\n";
+    }
+}
+
+std::vector<CameraKeyframe> read_camera_path(const std::string &fname)
+{
+    std::ifstream in(fname);
+    if (!in.is_open()) {
+        throw std::runtime_error("Failed to open file: " + fname);
+    }
+    std::vector<CameraKeyframe> path;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::stringstream values(line);
+        double seconds;
+        glm::vec3 c;
+        float distance;
+        glm::quat r;
+        if (!(values >> seconds >> c.x >> c.y >> c.z >> distance >> r.w >> r.x >> r.y >> r.z)) {
+            throw std::runtime_error(fname + ": malformed keyframe '" + line + "'");
+        }
+        path.emplace_back(seconds, ArcballCamera(c, distance, r));
+    }
+    return path;
+}
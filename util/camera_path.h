@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "arcball_camera.h"
+
+/* A camera recorded seconds into a session */
+struct CameraKeyframe {
+    double seconds;
+    ArcballCamera camera;
+
+    CameraKeyframe(double seconds, const ArcballCamera &camera);
+};
+
+/* Between the keyframes a and b at t in [0, 1], the rotation slerped and the
+ * center and distance interpolated linearly
+ */
+ArcballCamera interpolate_camera(const ArcballCamera &a, const ArcballCamera &b, float t);
+
+// One keyframe per line: seconds, center xyz, distance, rotation wxyz
+void write_camera_path(const std::string &fname, const std::vector<CameraKeyframe> &path);
+
+std::vector<CameraKeyframe> read_camera_path(const std::string &fname);
@@ -0,0 +1,71 @@
+#include "frame_stats.h"
+#include <algorithm>
+#include <cmath>
+
+FrameHistory::FrameHistory(size_t capacity) : capacity(std::max(capacity, size_t(1)))
+{
+    frames.reserve(this->capacity);
+}
+
+const FrameStats &FrameHistory::at(size_t i) const
+{
+    const size_t first = added - frames.size();
+    return frames[(first + i) % capacity];
+}
+
+void FrameHistory::add(const FrameStats &stats)
+{
+    if (frames.size() < capacity) {
+        frames.push_back(stats);
+    } else {
+        frames[added % capacity] = stats;
+    }
+    ++added;
+}
+
+size_t FrameHistory::size() const
+{
+    return frames.size();
+}
+
+const FrameStats &FrameHistory::back() const
+{
+    return at(frames.size() - 1);
+}
+
+std::vector<float> FrameHistory::recent_render_ms(size_t n) const
+{
+    n = std::min(n, frames.size());
+    std::vector<float> ms;
+    ms.reserve(n);
+    for (size_t i = frames.size() - n; i < frames.size(); ++i) {
+        ms.push_back(at(i).render_seconds * 1000.f);
+    }
+    return ms;
+}
+
+float FrameHistory::render_percentile_ms(float p, size_t n) const
+{
+    std::vector<float> ms = recent_render_ms(n);
+    if (ms.empty()) {
+        return 0.f;
+    }
+    // Nearest rank
+    const size_t rank = std::min(
+        size_t(std::max(std::ceil(p / 100.f * ms.size()), 1.f)) - 1, ms.size() - 1);
+    std::nth_element(ms.begin(), ms.begin() + rank, ms.end());
+    return ms[rank];
+}
+
+void FrameHistory::write_csv(std::ostream &os) const
+{
+    os << "frame,width,height,samples,commit_ms,render_ms,map_ms,upload_ms,variance\n";
+    const size_t first = added - frames.size();
+    for (size_t i = 0; i < frames.size(); ++i) {
+        const FrameStats &f = at(i);
+        os << first + i << "," << f.width << "," << f.height << "," << f.samples << ","
+           << f.commit_seconds * 1000.f << "," << f.render_seconds * 1000.f << ","
+           << f.map_seconds * 1000.f << "," << f.upload_seconds * 1000.f << "," << f.variance
+           << "\n";
+    }
+}
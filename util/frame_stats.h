@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+// Where the time of one rendered frame went
+struct FrameStats {
+    int width = 0;
+    int height = 0;
+    // Samples per pixel accumulated in the framebuffer with this frame
+    size_t samples = 0;
+    // Applying scene changes and committing them before the frame
+    float commit_seconds = 0.f;
+    float render_seconds = 0.f;
+    // Mapping the framebuffer and copying the frame out of it
+    float map_seconds = 0.f;
+    // Copying the frame into the display texture
+    float upload_seconds = 0.f;
+    // Estimated by OSPRay for accumulated frames, 0 when not known
+    float variance = 0.f;
+};
+
+/* Stats of the last frames rendered, in order. Only the newest capacity
+ * frames are kept, in a ring, so long sessions do not grow it.
+ */
+class FrameHistory {
+    std::vector<FrameStats> frames;
+    size_t capacity;
+    // Frames added since startup, the next one goes to added % capacity
+    size_t added = 0;
+
+    // The i-th oldest frame held
+    const FrameStats &at(size_t i) const;
+
+public:
+    FrameHistory(size_t capacity);
+
+    void add(const FrameStats &stats);
+
+    // Frames held, at most capacity
+    size_t size() const;
+
+    const FrameStats &back() const;
+
+    // Render times of the last n frames in milliseconds, oldest first
+    std::vector<float> recent_render_ms(size_t n) const;
+
+    // The p-th percentile, p in [0, 100], of the render time of the last n
+    // frames in milliseconds
+    float render_percentile_ms(float p, size_t n) const;
+
+    // One line per frame held with the times in milliseconds, numbered
+    // from startup
+    void write_csv(std::ostream &os) const;
+};
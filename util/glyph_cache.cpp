@@ -0,0 +1,190 @@
+#include "glyph_cache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+const static char glyph_cache_magic[8] = {'S', 'H', 'G', 'L', 'Y', 'P', 'H', 'C'};
+// Bumped whenever the layout or how the values are computed changes
+const static uint32_t glyph_cache_version = 1;
+// The header is padded to this, the arrays follow 16 byte aligned
+const static size_t header_bytes = 128;
+
+struct GlyphCacheHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t timestep;
+    int32_t basis;
+    int32_t dims[3];
+    int32_t record_stride;
+    float sh_scale;
+    float sh_0_scale;
+    uint64_t dataset_size;
+    int64_t dataset_mtime;
+    // Of the dataset path
+    uint64_t dataset_hash;
+};
+static_assert(sizeof(GlyphCacheHeader) <= header_bytes, "glyph cache header too large");
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t n)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < n; ++i) {
+        h = (h ^ bytes[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+static size_t align16(size_t n)
+{
+    return (n + 15) & ~size_t(15);
+}
+
+// Create the directory and its parents, ignoring the ones that exist
+static void make_dirs(const std::string &dir)
+{
+    size_t pos = 0;
+    do {
+        pos = dir.find_first_of("/\\", pos + 1);
+        const std::string parent = dir.substr(0, pos);
+#ifdef _WIN32
+        _mkdir(parent.c_str());
+#else
+        mkdir(parent.c_str(), 0755);
+#endif
+    } while (pos != std::string::npos);
+
+    struct stat st;
+    if (stat(dir.c_str(), &st) != 0 || !(st.st_mode & S_IFDIR)) {
+        throw std::runtime_error("Failed to create cache directory: " + dir);
+    }
+}
+
+GlyphCache::GlyphCache(const std::string &cache_dir, const GlyphCacheKey &key)
+    : n_voxels(size_t(key.dims[0]) * key.dims[1] * key.dims[2])
+{
+    GlyphCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, glyph_cache_magic, sizeof(glyph_cache_magic));
+    header.version = glyph_cache_version;
+    header.timestep = key.timestep;
+    header.basis = key.basis;
+    std::copy(key.dims, key.dims + 3, header.dims);
+    header.record_stride = key.record_stride;
+    header.sh_scale = key.sh_scale;
+    header.sh_0_scale = key.sh_0_scale;
+    header.dataset_size = key.dataset_size;
+    header.dataset_mtime = key.dataset_mtime;
+    header.dataset_hash = fnv1a(14695981039346656037ull, key.dataset.data(), key.dataset.size());
+
+    // One file per dataset, named after it so the directory can be cleaned
+    // up by hand. Opening it with another scale replaces it.
+    const size_t name_start = key.dataset.find_last_of("/\\");
+    std::stringstream name;
+    name << cache_dir << "/"
+         << key.dataset.substr(name_start == std::string::npos ? 0 : name_start + 1) << "."
+         << std::hex << header.dataset_hash << ".glyphs";
+    file_path = name.str();
+
+    const size_t aabb_flags_offset = header_bytes;
+    const size_t radius_flags_offset = aabb_flags_offset + n_voxels;
+    const size_t aabbs_offset = align16(radius_flags_offset + n_voxels);
+    const size_t radii_offset = align16(aabbs_offset + n_voxels * 3 * sizeof(float));
+    const size_t file_bytes = radii_offset + n_voxels * sizeof(float);
+
+    make_dirs(cache_dir);
+    // A file of another header, or cut short, is replaced rather than
+    // resized, as another loader may still have it mapped
+    {
+        std::ifstream existing(file_path, std::ios::binary | std::ios::ate);
+        if (existing.is_open()) {
+            const size_t existing_bytes = size_t(existing.tellg());
+            GlyphCacheHeader existing_header;
+            existing.seekg(0);
+            existing.read(reinterpret_cast<char *>(&existing_header), sizeof(existing_header));
+            existing.close();
+            if (existing_bytes != file_bytes
+                || std::memcmp(&existing_header, &header, sizeof(header)) != 0) {
+                std::remove(file_path.c_str());
+            }
+        }
+    }
+    file.reset(new MappedFile(file_path, file_bytes));
+    char *data = file->writable_data();
+    // A new file is all zeros, so no flags are set yet
+    if (std::memcmp(data, &header, sizeof(header)) != 0) {
+        std::memcpy(data, &header, sizeof(header));
+    }
+    voxel_aabb_flags = reinterpret_cast<uint8_t *>(data + aabb_flags_offset);
+    voxel_radius_flags = reinterpret_cast<uint8_t *>(data + radius_flags_offset);
+    voxel_aabbs = reinterpret_cast<float *>(data + aabbs_offset);
+    voxel_radii = reinterpret_cast<float *>(data + radii_offset);
+}
+
+std::string GlyphCache::default_dir()
+{
+    const char *xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg) {
+        return std::string(xdg) + "/osp_starter";
+    }
+#ifdef _WIN32
+    const char *local = std::getenv("LOCALAPPDATA");
+    if (local && *local) {
+        return std::string(local) + "/osp_starter";
+    }
+#else
+    const char *home = std::getenv("HOME");
+    if (home && *home) {
+        return std::string(home) + "/.cache/osp_starter";
+    }
+#endif
+    return "";
+}
+
+void GlyphCache::stat_dataset(GlyphCacheKey &key)
+{
+    struct stat st;
+    if (stat(key.dataset.c_str(), &st) != 0) {
+        throw std::runtime_error("Failed to stat file: " + key.dataset);
+    }
+    key.dataset_size = st.st_size;
+    key.dataset_mtime = st.st_mtime;
+}
+
+const std::string &GlyphCache::path() const
+{
+    return file_path;
+}
+
+size_t GlyphCache::size() const
+{
+    return n_voxels;
+}
+
+uint8_t *GlyphCache::aabb_flags()
+{
+    return voxel_aabb_flags;
+}
+
+float *GlyphCache::aabbs()
+{
+    return voxel_aabbs;
+}
+
+uint8_t *GlyphCache::radius_flags()
+{
+    return voxel_radius_flags;
+}
+
+float *GlyphCache::radii()
+{
+    return voxel_radii;
+}
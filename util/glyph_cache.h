@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "nrrd.h"
+
+/* What a glyph cache file was computed from. Repeated in the file header,
+ * so a file of another format version, dataset or scale is never used.
+ */
+struct GlyphCacheKey {
+    // The dataset file, with its size and modification time
+    std::string dataset;
+    uint64_t dataset_size = 0;
+    int64_t dataset_mtime = 0;
+    int timestep = 0;
+    // SHBasis the coefficients are converted from
+    int basis = 0;
+    int dims[3] = {0, 0, 0};
+    // Floats per voxel record in the dataset
+    int record_stride = 0;
+    // The scales the glyphs are rendered with
+    float sh_scale = 1.f;
+    float sh_0_scale = 1.f;
+};
+
+/* Per-voxel glyph AABB half extents and bound radii of one SH volume, kept
+ * across runs in a single file per dataset under a cache directory, which
+ * is started over when the dataset or scale changes. The file is mapped
+ * read-write: cached values are handed to the geometry in place, and new
+ * ones are written straight into it. Values are stored per voxel, so they
+ * are shared by every slice, clip box and mask of the dataset. A flag per
+ * voxel and value records whether it is filled in.
+ */
+class GlyphCache {
+    std::string file_path;
+    std::unique_ptr<MappedFile> file;
+    size_t n_voxels = 0;
+    uint8_t *voxel_aabb_flags = nullptr;
+    uint8_t *voxel_radius_flags = nullptr;
+    float *voxel_aabbs = nullptr;
+    float *voxel_radii = nullptr;
+
+public:
+    // Open the cache of the key in cache_dir, creating the directory or
+    // file if missing. Throws if either cannot be used.
+    GlyphCache(const std::string &cache_dir, const GlyphCacheKey &key);
+
+    // The directory caches go to unless the user picks one: under
+    // XDG_CACHE_HOME, ~/.cache or LOCALAPPDATA. Empty if none is set.
+    static std::string default_dir();
+
+    // Fill in the dataset's size and modification time, throws if it
+    // cannot be read
+    static void stat_dataset(GlyphCacheKey &key);
+
+    const std::string &path() const;
+
+    size_t size() const;
+
+    // Non-zero for the voxels whose AABB is filled in
+    uint8_t *aabb_flags();
+
+    // AABB half extents, 3 floats per voxel
+    float *aabbs();
+
+    // Non-zero for the voxels whose bound radius is filled in
+    uint8_t *radius_flags();
+
+    float *radii();
+};
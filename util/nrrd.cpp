@@ -0,0 +1,808 @@
+#include "nrrd.h"
+#include "sh_import.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_group.h>
+#ifdef NRRD_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// The header is at most this many lines
+const static int max_header_lines = 75;
+// Decompressed bytes handed to the scatter tasks at a time
+const static size_t decode_chunk_bytes = 16 * 1024 * 1024;
+// Voxels per side of the tiles the transposition works on, sized so the
+// source and destination footprint of a tile stays in L2
+const static int transpose_brick_size = 16;
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+MappedFile::MappedFile(const std::string &fname)
+{
+#ifdef _WIN32
+    file_handle = CreateFileA(fname.c_str(),
+                              GENERIC_READ,
+                              FILE_SHARE_READ,
+                              nullptr,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Failed to open file: " + fname);
+    }
+    LARGE_INTEGER li;
+    GetFileSizeEx(file_handle, &li);
+    file_size = li.QuadPart;
+    map_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!map_handle) {
+        CloseHandle(file_handle);
+        throw std::runtime_error("Failed to map file: " + fname);
+    }
+    mapping = static_cast<char *>(MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, 0));
+    if (!mapping) {
+        CloseHandle(map_handle);
+        CloseHandle(file_handle);
+        throw std::runtime_error("Failed to map file: " + fname);
+    }
+#else
+    const int fd = open(fname.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::runtime_error("Failed to open file: " + fname);
+    }
+    struct stat st;
+    fstat(fd, &st);
+    file_size = st.st_size;
+    void *m = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        throw std::runtime_error("Failed to map file: " + fname);
+    }
+    mapping = static_cast<char *>(m);
+#endif
+}
+
+MappedFile::MappedFile(const std::string &fname, size_t size) : file_size(size)
+{
+#ifdef _WIN32
+    file_handle = CreateFileA(fname.c_str(),
+                              GENERIC_READ | GENERIC_WRITE,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              nullptr,
+                              OPEN_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Failed to open file: " + fname);
+    }
+    LARGE_INTEGER li;
+    li.QuadPart = size;
+    if (!SetFilePointerEx(file_handle, li, nullptr, FILE_BEGIN) || !SetEndOfFile(file_handle)) {
+        CloseHandle(file_handle);
+        throw std::runtime_error("Failed to resize file: " + fname);
+    }
+    map_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+    if (!map_handle) {
+        CloseHandle(file_handle);
+        throw std::runtime_error("Failed to map file: " + fname);
+    }
+    mapping = static_cast<char *>(MapViewOfFile(map_handle, FILE_MAP_WRITE, 0, 0, 0));
+    if (!mapping) {
+        CloseHandle(map_handle);
+        CloseHandle(file_handle);
+        throw std::runtime_error("Failed to map file: " + fname);
+    }
+#else
+    const int fd = open(fname.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        throw std::runtime_error("Failed to open file: " + fname);
+    }
+    struct stat st;
+    fstat(fd, &st);
+    if (size_t(st.st_size) != size && ftruncate(fd, size) != 0) {
+        close(fd);
+        throw std::runtime_error("Failed to resize file: " + fname);
+    }
+    void *m = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        throw std::runtime_error("Failed to map file: " + fname);
+    }
+    mapping = static_cast<char *>(m);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+    UnmapViewOfFile(mapping);
+    CloseHandle(map_handle);
+    CloseHandle(file_handle);
+#else
+    munmap(mapping, file_size);
+#endif
+}
+
+const char *MappedFile::data() const
+{
+    return mapping;
+}
+
+char *MappedFile::writable_data()
+{
+    return mapping;
+}
+
+size_t MappedFile::size() const
+{
+    return file_size;
+}
+
+size_t NrrdHeader::num_voxels() const
+{
+    return size_t(dims[0]) * dims[1] * dims[2];
+}
+
+NrrdHeader read_nrrd_header(const std::string &fname)
+{
+    std::ifstream file(fname);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file: " + fname);
+    }
+
+    NrrdHeader header;
+    std::string line;
+    for (int i = 0; i < max_header_lines && std::getline(file, line); ++i) {
+        if (line.find("dim") != std::string::npos) {
+            // dim: x,y,z,sh or x,y,z,sh,t for a time series
+            size_t pos = 5;
+            for (int d = 0; d < 4; ++d) {
+                header.dims[d] = std::stoi(line.substr(pos));
+                pos = line.find(",", pos) + 1;
+            }
+            if (pos != 0) {
+                header.timesteps = std::stoi(line.substr(pos));
+            }
+        }
+        if (line.find("layout") != std::string::npos) {
+            // layout: +x,+y,+z,+sh, where the sign is the axis direction
+            // and the digit its order
+            size_t pos = 8;
+            for (int d = 0; d < 4; ++d) {
+                header.strides[d] = line[pos] == '+';
+                header.stride_order[d] = std::stoi(line.substr(pos + 1, 1));
+                pos = line.find(",", pos) + 1;
+            }
+            bool seen[4] = {false, false, false, false};
+            for (int d = 0; d < 4; ++d) {
+                if (header.stride_order[d] < 0 || header.stride_order[d] > 3
+                    || seen[header.stride_order[d]]) {
+                    throw std::runtime_error(fname
+                                             + ": layout axis order must be a permutation of 0-3");
+                }
+                seen[header.stride_order[d]] = true;
+            }
+        }
+        if (line.find("encoding") != std::string::npos) {
+            // encoding: raw|gzip
+            const size_t pos = line.find_first_not_of(" ", line.find(":") + 1);
+            header.encoding = line.substr(pos, line.find_last_not_of(" \r") + 1 - pos);
+            if (header.encoding == "gz") {
+                header.encoding = "gzip";
+            }
+        }
+        if (line.find("END") != std::string::npos) {
+            break;
+        }
+    }
+    header.data_offset = size_t(file.tellg()) + payload_padding;
+    return header;
+}
+
+void SHCoeffView::get(size_t i, float out[coeff_count]) const
+{
+    const float *c = data + i * stride;
+    out[0] = c[0] * scale_0 * scale;
+    for (int j = 1; j < coeff_count; ++j) {
+        out[j] = c[j] * scale;
+    }
+}
+
+SHCoeffView SHCoeffView::subview(size_t begin, size_t n) const
+{
+    SHCoeffView view = *this;
+    view.data = data + begin * stride;
+    view.count = n;
+    return view;
+}
+
+SHCoeffView SHCoeffView::gather(const std::vector<size_t> &indices,
+                                std::vector<float> &out) const
+{
+    out.resize(indices.size() * coeff_count);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, indices.size()),
+                      [&](const tbb::blocked_range<size_t> &r) {
+                          for (size_t i = r.begin(); i < r.end(); ++i) {
+                              std::memcpy(&out[i * coeff_count],
+                                          data + indices[i] * stride,
+                                          coeff_count * sizeof(float));
+                          }
+                      });
+    SHCoeffView view = *this;
+    view.data = out.data();
+    view.count = indices.size();
+    view.stride = coeff_count;
+    return view;
+}
+
+float sh_gfa(const float coeffs[SHCoeffView::coeff_count])
+{
+    // The basis is orthonormal, so this is the standard deviation of the
+    // function over the sphere relative to its RMS
+    float sum_sq = 0.f;
+    for (int i = 0; i < SHCoeffView::coeff_count; ++i) {
+        sum_sq += coeffs[i] * coeffs[i];
+    }
+    return sum_sq > 0.f ? std::sqrt(std::max(1.f - coeffs[0] * coeffs[0] / sum_sq, 0.f)) : 0.f;
+}
+
+float sh_bound_radius(const float coeffs[SHCoeffView::coeff_count])
+{
+    const float inv_pi_4 = 0.25 / M_PI;
+    // Per band sum of squared coefficients, weighted by (2l + 1) / 4pi
+    float band_sums[3] = {0.f, 0.f, 0.f};
+    for (int i = 0; i < SHCoeffView::coeff_count; ++i) {
+        const int band = i == 0 ? 0 : (i < 6 ? 1 : 2);
+        band_sums[band] += coeffs[i] * coeffs[i];
+    }
+    return std::sqrt(3.f)
+        * std::sqrt(inv_pi_4 * band_sums[0] + 5.f * inv_pi_4 * band_sums[1]
+                    + 9.f * inv_pi_4 * band_sums[2]);
+}
+
+bool NrrdHeader::is_glyph_major() const
+{
+    return stride_order[0] == 1 && stride_order[1] == 2 && stride_order[2] == 3
+        && stride_order[3] == 0 && strides[0] && strides[1] && strides[2] && strides[3];
+}
+
+/* Write the 15 native coefficients of the voxel record whose coefficients
+ * are stride floats apart. A fixed-length gather with a sign per lane, which
+ * the compiler vectorizes.
+ */
+static inline void convert_record(const float *record,
+                                  int64_t stride,
+                                  const int source[SHCoeffView::coeff_count],
+                                  const float sign[SHCoeffView::coeff_count],
+                                  float *out)
+{
+    for (int c = 0; c < SHCoeffView::coeff_count; ++c) {
+        out[c] = source[c] < 0 ? 0.f : sign[c] * record[source[c] * stride];
+    }
+}
+
+/* Signed source stride of each axis in floats, and the offset of the logical
+ * origin once flipped axes are accounted for
+ */
+static int64_t axis_strides(const NrrdHeader &header, int64_t stride[4])
+{
+    int64_t extent = 1;
+    for (int rank = 0; rank < 4; ++rank) {
+        const int axis = std::find(header.stride_order, header.stride_order + 4, rank)
+            - header.stride_order;
+        stride[axis] = extent;
+        extent *= header.dims[axis];
+    }
+    int64_t origin = 0;
+    for (int axis = 0; axis < 4; ++axis) {
+        if (!header.strides[axis]) {
+            origin += (header.dims[axis] - 1) * stride[axis];
+            stride[axis] = -stride[axis];
+        }
+    }
+    return origin;
+}
+
+/* Copy the voxel box [lo, hi) of a payload in any layout into out, which
+ * points at voxel lo of an output with out_w voxels per row and out_h rows
+ * per plane
+ */
+static void copy_box_glyph_major(const float *src,
+                                 const NrrdHeader &header,
+                                 const int lo[3],
+                                 const int hi[3],
+                                 float *out,
+                                 size_t out_w,
+                                 size_t out_h)
+{
+    const size_t coeff_count = SHCoeffView::coeff_count;
+    int64_t stride[4];
+    const int64_t origin = axis_strides(header, stride);
+    // With the SH axis fastest each voxel is one contiguous read, otherwise
+    // walk a coefficient plane of the box at a time
+    const bool sh_inner = std::abs(stride[3]) == 1;
+    // The basis is converted on the way
+    int source[coeff_count];
+    float sign[coeff_count];
+    sh_basis_conversion(header.basis, header.dims[3], source, sign);
+
+    const int c_end = sh_inner ? 1 : coeff_count;
+    for (int c_outer = 0; c_outer < c_end; ++c_outer) {
+        for (int z = lo[2]; z < hi[2]; ++z) {
+            for (int y = lo[1]; y < hi[1]; ++y) {
+                const int64_t row = origin + z * stride[2] + y * stride[1];
+                float *dst =
+                    out + ((size_t(z - lo[2]) * out_h + y - lo[1]) * out_w) * coeff_count;
+                for (int x = lo[0]; x < hi[0]; ++x) {
+                    const int64_t voxel = row + x * stride[0];
+                    float *record = dst + (x - lo[0]) * coeff_count;
+                    if (sh_inner) {
+                        convert_record(src + voxel, stride[3], source, sign, record);
+                    } else if (source[c_outer] < 0) {
+                        record[c_outer] = 0.f;
+                    } else {
+                        record[c_outer] =
+                            sign[c_outer] * src[voxel + source[c_outer] * stride[3]];
+                    }
+                }
+            }
+        }
+    }
+}
+
+void transpose_to_glyph_major(const float *src, const NrrdHeader &header, float *out)
+{
+    const int *dims = header.dims;
+    const int n_bricks[3] = {(dims[0] + transpose_brick_size - 1) / transpose_brick_size,
+                             (dims[1] + transpose_brick_size - 1) / transpose_brick_size,
+                             (dims[2] + transpose_brick_size - 1) / transpose_brick_size};
+    const size_t total_bricks = size_t(n_bricks[0]) * n_bricks[1] * n_bricks[2];
+    using range_type = tbb::blocked_range<size_t>;
+    tbb::parallel_for(range_type(0, total_bricks), [&](const range_type &r) {
+        for (size_t b = r.begin(); b < r.end(); ++b) {
+            const size_t brick[3] = {b % n_bricks[0],
+                                     b / n_bricks[0] % n_bricks[1],
+                                     b / (size_t(n_bricks[0]) * n_bricks[1])};
+            const int lo[3] = {int(brick[0]) * transpose_brick_size,
+                               int(brick[1]) * transpose_brick_size,
+                               int(brick[2]) * transpose_brick_size};
+            const int hi[3] = {std::min(lo[0] + transpose_brick_size, dims[0]),
+                               std::min(lo[1] + transpose_brick_size, dims[1]),
+                               std::min(lo[2] + transpose_brick_size, dims[2])};
+            const size_t first = (size_t(lo[2]) * dims[1] + lo[1]) * dims[0] + lo[0];
+            copy_box_glyph_major(src,
+                                 header,
+                                 lo,
+                                 hi,
+                                 out + first * SHCoeffView::coeff_count,
+                                 dims[0],
+                                 dims[1]);
+        }
+    });
+}
+
+void read_glyph_major_box(const float *src,
+                          const NrrdHeader &header,
+                          const int lo[3],
+                          const int hi[3],
+                          float *out)
+{
+    copy_box_glyph_major(src, header, lo, hi, out, hi[0] - lo[0], hi[1] - lo[1]);
+}
+
+#ifdef NRRD_HAVE_ZLIB
+/* Inflate exactly n_bytes into out, feeding the payload from in_offset on.
+ * Concatenated gzip members, e.g. from pigz, are decoded as one stream.
+ */
+static void inflate_exact(z_stream &zs,
+                          const char *payload,
+                          size_t payload_size,
+                          size_t &in_offset,
+                          char *out,
+                          size_t n_bytes)
+{
+    zs.next_out = reinterpret_cast<Bytef *>(out);
+    zs.avail_out = n_bytes;
+    while (zs.avail_out > 0) {
+        if (zs.avail_in == 0 && in_offset < payload_size) {
+            const size_t n_in = std::min(payload_size - in_offset, size_t(UINT_MAX));
+            zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(payload + in_offset));
+            zs.avail_in = n_in;
+            in_offset += n_in;
+        }
+        const int ret = inflate(&zs, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END && (zs.avail_in > 0 || in_offset < payload_size)) {
+            inflateReset(&zs);
+        } else if (ret == Z_STREAM_END || ret == Z_BUF_ERROR) {
+            break;
+        } else if (ret != Z_OK) {
+            throw std::runtime_error("Failed to inflate gzip payload");
+        }
+    }
+    if (zs.avail_out > 0) {
+        throw std::runtime_error("gzip payload is smaller than its header claims");
+    }
+}
+
+/* Inflate a gzip payload of skip_bytes + total_bytes, dropping the first
+ * skip_bytes and handing the rest to consume(chunk, offset, size) in pieces
+ * of chunk_bytes. Deflate streams can only be decoded sequentially, so
+ * inflating runs on this thread into one of two chunk buffers while the
+ * previous chunk is consumed on a task.
+ */
+template <typename F>
+static void inflate_chunks(const char *payload,
+                           size_t payload_size,
+                           size_t skip_bytes,
+                           size_t total_bytes,
+                           size_t chunk_bytes,
+                           const F &consume)
+{
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    // 32 + MAX_WBITS accepts both gzip and zlib headers
+    if (inflateInit2(&zs, 32 + MAX_WBITS) != Z_OK) {
+        throw std::runtime_error("Failed to initialize zlib");
+    }
+
+    std::vector<char> chunks[2];
+    chunks[0].resize(chunk_bytes);
+    chunks[1].resize(chunk_bytes);
+    tbb::task_group consumer;
+    int current = 0;
+    size_t in_offset = 0;
+    try {
+        // Earlier timesteps of a series still have to be decoded to get past them
+        for (size_t skipped = 0; skipped < skip_bytes; skipped += chunk_bytes) {
+            inflate_exact(zs,
+                          payload,
+                          payload_size,
+                          in_offset,
+                          chunks[0].data(),
+                          std::min(chunk_bytes, skip_bytes - skipped));
+        }
+        for (size_t offset = 0; offset < total_bytes; offset += chunk_bytes) {
+            const size_t n_bytes = std::min(chunk_bytes, total_bytes - offset);
+            char *chunk = chunks[current].data();
+            inflate_exact(zs, payload, payload_size, in_offset, chunk, n_bytes);
+
+            // The task still running reads the other buffer
+            consumer.wait();
+            consumer.run([=, &consume]() { consume(chunk, offset, n_bytes); });
+            current = 1 - current;
+        }
+    } catch (...) {
+        consumer.wait();
+        inflateEnd(&zs);
+        throw;
+    }
+    consumer.wait();
+    inflateEnd(&zs);
+}
+
+/* A member of a BGZF payload, the blocked gzip written by bgzip: a series
+ * of gzip members of at most 64 KB whose headers record their compressed
+ * size and whose trailers record their inflated size, so they can be found
+ * without inflating anything and inflated independently.
+ */
+struct GzipMember {
+    size_t offset;
+    size_t size;
+    // Where its inflated bytes go in the whole inflated payload
+    size_t out_offset;
+    size_t out_size;
+};
+
+static uint32_t read_le(const unsigned char *p, int n)
+{
+    uint32_t v = 0;
+    for (int i = n - 1; i >= 0; --i) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+/* The members of a BGZF payload, found by following the block sizes in
+ * their headers. Empty if the payload is not BGZF, it is then inflated as
+ * one stream.
+ */
+static std::vector<GzipMember> bgzf_members(const char *payload, size_t payload_size)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(payload);
+    std::vector<GzipMember> members;
+    size_t offset = 0;
+    size_t out_offset = 0;
+    while (offset < payload_size) {
+        const unsigned char *h = p + offset;
+        const size_t left = payload_size - offset;
+        // gzip magic, deflate, FEXTRA set, and bgzip's 'BC' subfield with
+        // the block size first in the extra field
+        if (left < 18 || h[0] != 0x1f || h[1] != 0x8b || h[2] != 8 || !(h[3] & 4)
+            || read_le(h + 10, 2) < 6 || h[12] != 'B' || h[13] != 'C'
+            || read_le(h + 14, 2) != 2) {
+            return {};
+        }
+        const size_t size = read_le(h + 16, 2) + 1;
+        if (size < 26 || size > left) {
+            return {};
+        }
+        const size_t out_size = read_le(h + size - 4, 4);
+        members.push_back(GzipMember{offset, size, out_offset, out_size});
+        offset += size;
+        out_offset += out_size;
+    }
+    return members;
+}
+
+// Inflate a whole member into out, which has room for its out_size bytes
+static void inflate_member(const char *payload, const GzipMember &member, char *out)
+{
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    // 16 + MAX_WBITS accepts only a gzip header
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) {
+        throw std::runtime_error("Failed to initialize zlib");
+    }
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(payload + member.offset));
+    zs.avail_in = member.size;
+    zs.next_out = reinterpret_cast<Bytef *>(out);
+    zs.avail_out = member.out_size;
+    const int ret = inflate(&zs, Z_FINISH);
+    const bool complete = ret == Z_STREAM_END && zs.avail_out == 0;
+    inflateEnd(&zs);
+    if (!complete) {
+        throw std::runtime_error("Failed to inflate BGZF block");
+    }
+}
+
+/* Like inflate_chunks for a BGZF payload, but the members each chunk
+ * overlaps are inflated in parallel, and the members of skipped timesteps
+ * are not inflated at all.
+ */
+template <typename F>
+static void inflate_members_chunks(const char *payload,
+                                   const std::vector<GzipMember> &members,
+                                   size_t skip_bytes,
+                                   size_t total_bytes,
+                                   size_t chunk_bytes,
+                                   const F &consume)
+{
+    const GzipMember &last = members.back();
+    if (last.out_offset + last.out_size < skip_bytes + total_bytes) {
+        throw std::runtime_error("gzip payload is smaller than its header claims");
+    }
+    std::vector<char> chunk(chunk_bytes);
+    for (size_t offset = 0; offset < total_bytes; offset += chunk_bytes) {
+        const size_t n_bytes = std::min(chunk_bytes, total_bytes - offset);
+        const size_t lo = skip_bytes + offset;
+        const size_t hi = lo + n_bytes;
+        // The members overlapping [lo, hi)
+        auto first = std::upper_bound(
+            members.begin(), members.end(), lo, [](size_t v, const GzipMember &m) {
+                return v < m.out_offset + m.out_size;
+            });
+        auto end = std::lower_bound(
+            first, members.end(), hi, [](const GzipMember &m, size_t v) {
+                return m.out_offset < v;
+            });
+        tbb::parallel_for(size_t(0), size_t(end - first), [&](size_t i) {
+            const GzipMember &m = first[i];
+            if (m.out_size == 0) {
+                return;
+            }
+            if (m.out_offset >= lo && m.out_offset + m.out_size <= hi) {
+                inflate_member(payload, m, chunk.data() + (m.out_offset - lo));
+                return;
+            }
+            // Straddles the chunk boundary, only part of it is copied
+            std::vector<char> inflated(m.out_size);
+            inflate_member(payload, m, inflated.data());
+            const size_t from = std::max(lo, m.out_offset);
+            const size_t to = std::min(hi, m.out_offset + m.out_size);
+            std::memcpy(
+                chunk.data() + (from - lo), inflated.data() + (from - m.out_offset), to - from);
+        });
+        consume(chunk.data(), offset, n_bytes);
+    }
+}
+
+/* Inflate the gzip payload into glyph-major coefficients. A glyph-major
+ * payload is streamed, each chunk of voxel records scattered into out in
+ * parallel, so the whole decompressed payload is never held at once. Any
+ * other layout needs random access and is inflated fully, then transposed.
+ * BGZF payloads are inflated block-parallel, any other gzip payload is one
+ * sequential stream.
+ */
+static void inflate_coeffs(const char *payload,
+                           size_t payload_size,
+                           const NrrdHeader &header,
+                           int timestep,
+                           float *out,
+                           SHLoadStats &stats)
+{
+    const size_t coeff_count = SHCoeffView::coeff_count;
+    const size_t record_bytes = header.dims[3] * sizeof(float);
+    const size_t total_bytes = header.num_voxels() * record_bytes;
+    const size_t skip_bytes = timestep * total_bytes;
+
+    auto start = std::chrono::steady_clock::now();
+    stats.read_bytes = payload_size;
+    const std::vector<GzipMember> members = bgzf_members(payload, payload_size);
+    stats.read_method = members.empty() ? "inflate" : "parallel inflate";
+    auto inflate_payload = [&](size_t chunk_bytes, const auto &consume) {
+        if (members.empty()) {
+            inflate_chunks(
+                payload, payload_size, skip_bytes, total_bytes, chunk_bytes, consume);
+        } else {
+            inflate_members_chunks(
+                payload, members, skip_bytes, total_bytes, chunk_bytes, consume);
+        }
+    };
+    if (!header.is_glyph_major()) {
+        std::vector<float> raw(header.num_voxels() * header.dims[3]);
+        inflate_payload(decode_chunk_bytes,
+                        [&](const char *chunk, size_t offset, size_t n_bytes) {
+                            std::memcpy(reinterpret_cast<char *>(raw.data()) + offset,
+                                        chunk,
+                                        n_bytes);
+                        });
+        stats.read_seconds = seconds_since(start);
+        start = std::chrono::steady_clock::now();
+        transpose_to_glyph_major(raw.data(), header, out);
+        stats.transform_seconds = seconds_since(start);
+        return;
+    }
+
+    int source[coeff_count];
+    float sign[coeff_count];
+    sh_basis_conversion(header.basis, header.dims[3], source, sign);
+    const size_t chunk_records = std::max(size_t(1), decode_chunk_bytes / record_bytes);
+    inflate_payload(chunk_records * record_bytes,
+                    [&](const char *chunk, size_t offset, size_t n_bytes) {
+                        using range_type = tbb::blocked_range<size_t>;
+                        const size_t voxel = offset / record_bytes;
+                        tbb::parallel_for(range_type(0, n_bytes / record_bytes),
+                                          [&](const range_type &r) {
+                                              for (size_t i = r.begin(); i < r.end(); ++i) {
+                                                  const float *record =
+                                                      reinterpret_cast<const float *>(
+                                                          chunk + i * record_bytes);
+                                                  float *dst = out + (voxel + i) * coeff_count;
+                                                  convert_record(record, 1, source, sign, dst);
+                                              }
+                                          });
+                   });
+    // Scattering into glyph-major order overlaps with inflating a single
+    // stream, BGZF chunks are inflated, then scattered
+    stats.read_seconds = seconds_since(start);
+}
+#endif
+
+SHVolume map_sh_volume(const std::string &fname,
+                       int timestep,
+                       SHBasis npy_basis,
+                       bool convert)
+{
+    auto start = std::chrono::steady_clock::now();
+    SHVolume volume;
+    volume.header = read_sh_header(fname, npy_basis);
+    // Converted bases may have lmax = 2 and get padded
+    const bool native = volume.header.basis == SHBasis::Native;
+    if (volume.header.dims[3] < (native ? SHCoeffView::coeff_count : 6)) {
+        throw std::runtime_error(fname + ": expected at least "
+                                 + std::to_string(native ? SHCoeffView::coeff_count : 6)
+                                 + " SH coefficients per voxel");
+    }
+    if (timestep < 0 || timestep >= volume.header.timesteps) {
+        throw std::runtime_error(fname + ": no timestep " + std::to_string(timestep));
+    }
+
+    volume.file = std::make_shared<MappedFile>(fname);
+    if (volume.header.data_offset > volume.file->size()) {
+        throw std::runtime_error(fname + ": file is smaller than its header claims");
+    }
+    volume.stats.header_seconds = seconds_since(start);
+    volume.coeffs.count = volume.header.num_voxels();
+    if (volume.header.encoding == "gzip") {
+#ifdef NRRD_HAVE_ZLIB
+        volume.decoded = std::make_shared<std::vector<float>>(volume.header.num_voxels()
+                                                              * SHCoeffView::coeff_count);
+        inflate_coeffs(volume.file->data() + volume.header.data_offset,
+                       volume.file->size() - volume.header.data_offset,
+                       volume.header,
+                       timestep,
+                       volume.decoded->data(),
+                       volume.stats);
+        // The compressed file is not needed once it is decoded
+        volume.file = nullptr;
+        volume.coeffs.data = volume.decoded->data();
+        return volume;
+#else
+        throw std::runtime_error(fname + ": gzip encoding requires building with zlib");
+#endif
+    }
+    if (volume.header.encoding != "raw") {
+        throw std::runtime_error(fname + ": unsupported encoding '" + volume.header.encoding
+                                 + "'");
+    }
+
+    const size_t payload_size =
+        volume.header.num_voxels() * volume.header.dims[3] * sizeof(float);
+    // Timesteps follow each other, each a whole volume
+    const size_t payload_offset = volume.header.data_offset + timestep * payload_size;
+    if (payload_offset + payload_size > volume.file->size()) {
+        throw std::runtime_error(fname + ": file is smaller than its header claims");
+    }
+
+    const float *payload =
+        reinterpret_cast<const float *>(volume.file->data() + payload_offset);
+    if (volume.header.is_glyph_major() && native) {
+        volume.coeffs.data = payload;
+        volume.coeffs.stride = volume.header.dims[3];
+        return volume;
+    }
+    if (!convert) {
+        volume.payload = payload;
+        return volume;
+    }
+
+    // The payload is paged in while it is transposed, so reading it is part
+    // of the transform here
+    start = std::chrono::steady_clock::now();
+    volume.decoded = std::make_shared<std::vector<float>>(volume.header.num_voxels()
+                                                          * SHCoeffView::coeff_count);
+    transpose_to_glyph_major(payload, volume.header, volume.decoded->data());
+    volume.stats.transform_seconds = seconds_since(start);
+    volume.file = nullptr;
+    volume.coeffs.data = volume.decoded->data();
+    return volume;
+}
+
+std::vector<uint8_t> read_mask_volume(const std::string &fname, NrrdHeader &header)
+{
+    header = read_nrrd_header(fname);
+    if (header.dims[3] != 1 || header.encoding != "raw") {
+        throw std::runtime_error(fname + ": expected a raw mask with one value per voxel");
+    }
+    MappedFile file(fname);
+    if (header.data_offset + header.num_voxels() * sizeof(float) > file.size()) {
+        throw std::runtime_error(fname + ": file is smaller than its header claims");
+    }
+    const float *src = reinterpret_cast<const float *>(file.data() + header.data_offset);
+
+    int64_t stride[4];
+    const int64_t origin = axis_strides(header, stride);
+    std::vector<uint8_t> mask(header.num_voxels());
+    tbb::parallel_for(0, header.dims[2], [&](int z) {
+        for (int y = 0; y < header.dims[1]; ++y) {
+            const int64_t row = origin + z * stride[2] + y * stride[1];
+            uint8_t *dst = &mask[(size_t(z) * header.dims[1] + y) * header.dims[0]];
+            for (int x = 0; x < header.dims[0]; ++x) {
+                dst[x] = src[row + x * stride[0]] != 0.f;
+            }
+        }
+    });
+    return mask;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Bytes between the end of the header's END line and the first float of
+// the payload
+const static int payload_padding = 9;
+
+/* A memory mapping of a whole file, read-only unless it is created with a
+ * size. The mapping lives as long as the object, so data handed to OSPRay as
+ * shared data must keep it alive.
+ */
+class MappedFile {
+    char *mapping = nullptr;
+    size_t file_size = 0;
+#ifdef _WIN32
+    void *file_handle = nullptr;
+    void *map_handle = nullptr;
+#endif
+
+public:
+    MappedFile(const std::string &fname);
+
+    // Map the file read-write, creating it or resizing it to size bytes
+    // first. Writes go to the file.
+    MappedFile(const std::string &fname, size_t size);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const;
+
+    // Only for files mapped read-write
+    char *writable_data();
+
+    size_t size() const;
+};
+
+/* The SH basis of the coefficients in a file. Native is the basis and order
+ * documented in module/sh.ih. The others are the real, orthonormal bases of
+ * DIPY's descoteaux07 (legacy) and of MRtrix3 (DIPY's tournier07), both
+ * with the even bands of lmax >= 4 stored band by band.
+ */
+enum class SHBasis { Native, Descoteaux07, Tournier07 };
+
+/* The header of an SH volume: 3 spatial axes plus the SH coefficient axis,
+ * with the per-axis direction (strides) and axis order from the layout line.
+ * stride_order is the rank of each axis in memory, 0 being fastest. A time
+ * series adds a fifth dim, always the slowest axis, so every timestep is a
+ * whole volume in that layout.
+ */
+struct NrrdHeader {
+    // x, y, z, sh
+    int dims[4] = {0, 0, 0, 0};
+    bool strides[4] = {true, true, true, true};
+    int stride_order[4] = {1, 2, 3, 0};
+    int timesteps = 1;
+    SHBasis basis = SHBasis::Native;
+    // raw or gzip
+    std::string encoding = "raw";
+    // Byte offset of the raw payload in the file
+    size_t data_offset = 0;
+
+    size_t num_voxels() const;
+
+    // SH fastest, then x, y, z, with no flipped axes
+    bool is_glyph_major() const;
+};
+
+NrrdHeader read_nrrd_header(const std::string &fname);
+
+/* Copy the first 15 coefficients of every voxel of a payload stored in any
+ * axis order, direction and SH basis into out, 15 per voxel in the native
+ * basis with x fastest, then y, z. Runs in parallel over bricks of voxels.
+ */
+void transpose_to_glyph_major(const float *src, const NrrdHeader &header, float *out);
+
+/* Copy the voxel box [lo, hi) of such a payload into out the same way, 15
+ * per voxel with x fastest, for reading a volume in parts
+ */
+void read_glyph_major_box(const float *src,
+                          const NrrdHeader &header,
+                          const int lo[3],
+                          const int hi[3],
+                          float *out);
+
+/* A strided view of per-glyph SH coefficients. Glyph i starts at
+ * data + i * stride and the first 15 floats are used. The scales are
+ * applied on read and not baked into the data, so the view can point
+ * straight into a mapped file.
+ */
+struct SHCoeffView {
+    static const int coeff_count = 15;
+
+    const float *data = nullptr;
+    size_t count = 0;
+    // In floats between consecutive glyphs
+    size_t stride = coeff_count;
+    float scale = 1.f;
+    float scale_0 = 1.f;
+
+    // Read the scaled coefficients of glyph i
+    void get(size_t i, float out[coeff_count]) const;
+
+    // Restrict the view to glyphs [begin, begin + n)
+    SHCoeffView subview(size_t begin, size_t n) const;
+
+    // Copy the glyphs at the indices into out, unscaled, and view them there
+    SHCoeffView gather(const std::vector<size_t> &indices, std::vector<float> &out) const;
+};
+
+// Upper bound on the radius of the glyph with these 15 SH coefficients
+float sh_bound_radius(const float coeffs[SHCoeffView::coeff_count]);
+
+// Generalized fractional anisotropy of the glyph, 0 for an isotropic one
+float sh_gfa(const float coeffs[SHCoeffView::coeff_count]);
+
+// Where the time of loading a volume went
+struct SHLoadStats {
+    double header_seconds = 0.0;
+    // Reading and decoding the payload. A mapped raw payload is not read up
+    // front, its pages come in as the glyphs are first touched
+    double read_seconds = 0.0;
+    size_t read_bytes = 0;
+    // How the payload was read, for the timing label: read, inflate for a
+    // single gzip stream or parallel inflate for a BGZF one
+    std::string read_method = "read";
+    // Converting the layout to glyph-major
+    double transform_seconds = 0.0;
+};
+
+struct SHVolume {
+    NrrdHeader header;
+    SHLoadStats stats;
+    std::shared_ptr<MappedFile> file;
+    // Decoded coefficients, 15 per voxel, when the payload is compressed or
+    // not stored glyph-major
+    std::shared_ptr<std::vector<float>> decoded;
+    // All voxels of the volume, glyph-major with x fastest, then y, z.
+    // Empty when a raw payload is mapped without converting it.
+    SHCoeffView coeffs;
+    // The mapped raw payload of the timestep as stored, when it is not
+    // converted, to be read with read_glyph_major_box
+    const float *payload = nullptr;
+};
+
+/* Map the SH volume, or one timestep of a time series. A raw glyph-major
+ * payload in the native basis is not copied or converted and only the pages
+ * touched through the view are ever read from disk. Other layouts and bases
+ * are converted, and a gzip payload is inflated chunk by chunk into the
+ * decoded coefficients. MRtrix .mif and NumPy .npy files are read too, see
+ * sh_import.h, .npy ones in npy_basis. Without convert, a raw payload in
+ * another layout or basis is only mapped and left in payload, so it can be
+ * read a part at a time without holding the whole volume in memory.
+ */
+SHVolume map_sh_volume(const std::string &fname,
+                       int timestep = 0,
+                       SHBasis npy_basis = SHBasis::Descoteaux07,
+                       bool convert = true);
+
+/* Read a mask stored like an SH volume with a single float per voxel, in any
+ * layout, as one byte per voxel with x fastest, then y, z. Non-zero voxels
+ * are kept. The mask's header is returned in header, to check its dims
+ * against the volume's.
+ */
+std::vector<uint8_t> read_mask_volume(const std::string &fname, NrrdHeader &header);
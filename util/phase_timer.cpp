@@ -0,0 +1,94 @@
+#include "phase_timer.h"
+#include <algorithm>
+#include <iomanip>
+
+PhaseTimer::Scope::Scope(PhaseTimer &timer, const std::string &name, size_t bytes)
+    : timer(timer), name(name), bytes(bytes)
+{
+}
+
+PhaseTimer::Scope::~Scope()
+{
+    timer.add(name, std::chrono::duration<double>(clock::now() - start).count(), bytes);
+}
+
+void PhaseTimer::add(const std::string &name, double seconds, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto fnd = std::find_if(
+        phases.begin(), phases.end(), [&](const Phase &p) { return p.name == name; });
+    if (fnd == phases.end()) {
+        phases.push_back(Phase());
+        fnd = phases.end() - 1;
+        fnd->name = name;
+    }
+    fnd->seconds += seconds;
+    fnd->bytes += bytes;
+    ++fnd->count;
+}
+
+void PhaseTimer::mark(const std::string &name)
+{
+    const double seconds = std::chrono::duration<double>(clock::now() - start).count();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &m : milestones) {
+        if (m.first == name) {
+            return;
+        }
+    }
+    milestones.emplace_back(name, seconds);
+}
+
+bool PhaseTimer::has_mark(const std::string &name) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::any_of(milestones.begin(), milestones.end(), [&](const auto &m) {
+        return m.first == name;
+    });
+}
+
+void PhaseTimer::print(std::ostream &os) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto flags = os.flags();
+    os << std::left << std::setw(24) << "phase" << std::right << std::setw(8) << "count"
+       << std::setw(12) << "time (s)" << std::setw(12) << "MB/s"
+       << "\n";
+    os << std::fixed << std::setprecision(3);
+    for (const auto &p : phases) {
+        os << std::left << std::setw(24) << p.name << std::right << std::setw(8) << p.count
+           << std::setw(12) << p.seconds;
+        if (p.bytes > 0 && p.seconds > 0.0) {
+            const double mb_per_s = p.bytes / (1024.0 * 1024.0) / p.seconds;
+            os << std::setw(12) << std::setprecision(1) << mb_per_s << std::setprecision(3);
+        }
+        os << "\n";
+    }
+    for (const auto &m : milestones) {
+        os << std::left << std::setw(32) << m.first << std::right << std::setw(12) << m.second
+           << "\n";
+    }
+    os.flags(flags);
+}
+
+nlohmann::json PhaseTimer::to_json() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    nlohmann::json phase_list = nlohmann::json::array();
+    for (const auto &p : phases) {
+        nlohmann::json phase;
+        phase["name"] = p.name;
+        phase["count"] = p.count;
+        phase["seconds"] = p.seconds;
+        phase["bytes"] = p.bytes;
+        phase_list.push_back(phase);
+    }
+    nlohmann::json milestone_list = nlohmann::json::object();
+    for (const auto &m : milestones) {
+        milestone_list[m.first] = m.second;
+    }
+    nlohmann::json report;
+    report["phases"] = phase_list;
+    report["milestones"] = milestone_list;
+    return report;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "json.hpp"
+
+/* Wall-clock time spent in named phases, summed over every time a phase runs
+ * and over all threads, plus milestones measured from when the timer was
+ * created. Phases that process data record the bytes so throughput can be
+ * reported. Phases and milestones are listed in the order first seen.
+ */
+class PhaseTimer {
+    struct Phase {
+        std::string name;
+        double seconds = 0.0;
+        size_t bytes = 0;
+        size_t count = 0;
+    };
+    using clock = std::chrono::steady_clock;
+
+    clock::time_point start = clock::now();
+    std::vector<Phase> phases;
+    std::vector<std::pair<std::string, double>> milestones;
+    mutable std::mutex mutex;
+
+public:
+    /* Times the phase from construction until it goes out of scope */
+    class Scope {
+        PhaseTimer &timer;
+        std::string name;
+        size_t bytes;
+        clock::time_point start = clock::now();
+
+    public:
+        Scope(PhaseTimer &timer, const std::string &name, size_t bytes = 0);
+
+        ~Scope();
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+
+    void add(const std::string &name, double seconds, size_t bytes = 0);
+
+    // Record the time since the timer was created, once per name
+    void mark(const std::string &name);
+
+    bool has_mark(const std::string &name) const;
+
+    // Print the phases and milestones as a table
+    void print(std::ostream &os) const;
+
+    nlohmann::json to_json() const;
+};
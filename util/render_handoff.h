@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+/* A bounded queue between exactly one producer and one consumer thread,
+ * without locks. Each side only writes its own index and reads the other's,
+ * so push and pop never wait on each other. Capacity is N - 1 items.
+ */
+template <typename T, size_t N>
+class SPSCQueue {
+    std::array<T, N> items;
+    // Next slot to pop, written by the consumer
+    std::atomic<size_t> head{0};
+    // Next slot to push, written by the producer
+    std::atomic<size_t> tail{0};
+
+public:
+    // Returns false if the queue is full, leaving item untouched
+    bool push(T &&item)
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        const size_t next = (t + 1) % N;
+        if (next == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        items[t] = std::move(item);
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false if the queue is empty
+    bool pop(T &item)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = std::move(items[h]);
+        items[h] = T();
+        head.store((h + 1) % N, std::memory_order_release);
+        return true;
+    }
+};
+
+/* Hands the newest of a stream of values from one writer thread to one
+ * reader thread without locks or copies. The writer fills its back slot and
+ * swaps it with the shared middle one, the reader swaps the middle one for
+ * its front slot when a new value is there. Neither ever waits, and the
+ * reader only sees whole values, skipping any it was too slow for.
+ */
+template <typename T>
+class TripleBuffer {
+    static const uint8_t index_mask = 0x3;
+    // Set on the middle index when it holds a value the reader has not taken
+    static const uint8_t fresh_bit = 0x4;
+
+    T slots[3];
+    std::atomic<uint8_t> middle{1};
+    uint8_t back = 0;
+    uint8_t front = 2;
+
+public:
+    // The slot the writer fills next
+    T &write_slot()
+    {
+        return slots[back];
+    }
+
+    // Make the written slot the newest value. Returns true if the value it
+    // replaces was never read, that value is then the next write slot.
+    bool publish()
+    {
+        const uint8_t prev = middle.exchange(back | fresh_bit, std::memory_order_acq_rel);
+        back = prev & index_mask;
+        return prev & fresh_bit;
+    }
+
+    // Take the newest value if one came in since the last call, returns
+    // false if read_slot is unchanged
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_acquire) & fresh_bit)) {
+            return false;
+        }
+        front = middle.exchange(front, std::memory_order_acq_rel) & index_mask;
+        return true;
+    }
+
+    // The value the reader holds
+    T &read_slot()
+    {
+        return slots[front];
+    }
+};
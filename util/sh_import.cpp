@@ -0,0 +1,198 @@
+#include "sh_import.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+const static char npy_magic[6] = {'\x93', 'N', 'U', 'M', 'P', 'Y'};
+
+static bool ends_with(const std::string &str, const std::string &suffix)
+{
+    return str.size() >= suffix.size()
+        && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+void sh_basis_conversion(SHBasis basis,
+                         int n_coeffs,
+                         int source[SHCoeffView::coeff_count],
+                         float sign[SHCoeffView::coeff_count])
+{
+    // All bases order the coefficients by band l = 0, 2, 4 and then by
+    // order m = -l..l, so coefficient (l, m) is at l(l + 1)/2 + m
+    int c = 0;
+    for (int l = 0; l <= 4; l += 2) {
+        for (int m = -l; m <= l; ++m, ++c) {
+            const int odd = m % 2 != 0;
+            int src = c;
+            sign[c] = 1.f;
+            switch (basis) {
+            case SHBasis::Native:
+                break;
+            case SHBasis::Descoteaux07:
+                // Same functions, but the cosine terms carry the
+                // Condon-Shortley phase
+                if (m < 0 && odd) {
+                    sign[c] = -1.f;
+                }
+                break;
+            case SHBasis::Tournier07:
+                // Sine and cosine terms swap places and the native sine
+                // terms carry the Condon-Shortley phase
+                src = l * (l + 1) / 2 - m;
+                if (m > 0 && odd) {
+                    sign[c] = -1.f;
+                }
+                break;
+            }
+            source[c] = src < n_coeffs ? src : -1;
+        }
+    }
+}
+
+NrrdHeader read_mif_header(const std::string &fname)
+{
+    std::ifstream file(fname, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file: " + fname);
+    }
+
+    std::string line;
+    std::getline(file, line);
+    if (line.compare(0, 12, "mrtrix image") != 0) {
+        throw std::runtime_error(fname + ": not an MRtrix image");
+    }
+
+    NrrdHeader header;
+    header.basis = SHBasis::Tournier07;
+    bool have_offset = false;
+    while (std::getline(file, line) && line.compare(0, 3, "END") != 0) {
+        const size_t sep = line.find(':');
+        if (sep == std::string::npos) {
+            continue;
+        }
+        const std::string key = line.substr(0, sep);
+        std::string value = line.substr(sep + 1);
+        value = value.substr(0, value.find_last_not_of(" \r") + 1);
+        std::stringstream values(value);
+        std::string item;
+        if (key == "dim") {
+            // dim: x,y,z,sh
+            int d = 0;
+            for (; std::getline(values, item, ','); ++d) {
+                if (d < 4) {
+                    header.dims[d] = std::stoi(item);
+                }
+            }
+            if (d != 4) {
+                throw std::runtime_error(fname + ": expected a 4D SH image");
+            }
+        } else if (key == "layout") {
+            // layout: +0,+1,+2,+3, the sign is the axis direction and the
+            // digit its order, 0 being fastest
+            for (int d = 0; d < 4 && std::getline(values, item, ','); ++d) {
+                item = item.substr(item.find_first_not_of(' '));
+                header.strides[d] = item[0] != '-';
+                header.stride_order[d] = std::stoi(item.substr(1));
+            }
+        } else if (key == "datatype") {
+            if (value.find("Float32") == std::string::npos
+                || value.find("BE") != std::string::npos) {
+                throw std::runtime_error(fname + ": unsupported datatype '" + value
+                                         + "', expected Float32LE");
+            }
+        } else if (key == "file") {
+            // file: . offset, the payload follows the header in the same file
+            std::string data_file;
+            values >> data_file >> header.data_offset;
+            if (data_file != ".") {
+                throw std::runtime_error(fname + ": separate data files are not supported");
+            }
+            have_offset = true;
+        }
+    }
+    if (!have_offset) {
+        throw std::runtime_error(fname + ": missing 'file' entry");
+    }
+    return header;
+}
+
+NrrdHeader read_npy_header(const std::string &fname, SHBasis basis)
+{
+    std::ifstream file(fname, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file: " + fname);
+    }
+
+    char magic[6];
+    uint8_t version[2];
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char *>(version), sizeof(version));
+    if (!file.good() || std::memcmp(magic, npy_magic, sizeof(magic)) != 0) {
+        throw std::runtime_error(fname + ": not a NumPy array");
+    }
+    // Version 1 has a 16 bit header length, later ones 32 bit, little endian
+    uint8_t len_bytes[4] = {0, 0, 0, 0};
+    file.read(reinterpret_cast<char *>(len_bytes), version[0] == 1 ? 2 : 4);
+    const uint32_t header_len =
+        len_bytes[0] | len_bytes[1] << 8 | len_bytes[2] << 16 | uint32_t(len_bytes[3]) << 24;
+    std::string dict(header_len, '\0');
+    file.read(&dict[0], header_len);
+    if (!file.good()) {
+        throw std::runtime_error(fname + ": truncated NumPy header");
+    }
+
+    NrrdHeader header;
+    header.basis = basis;
+    header.data_offset = size_t(file.tellg());
+
+    // {'descr': '<f4', 'fortran_order': False, 'shape': (x, y, z, sh), }
+    const size_t descr = dict.find("'descr'");
+    if (descr == std::string::npos
+        || dict.compare(dict.find('\'', descr + 7) + 1, 3, "<f4") != 0) {
+        throw std::runtime_error(fname + ": expected an array of little-endian float32");
+    }
+    const size_t order = dict.find("'fortran_order'");
+    const bool fortran_order = order != std::string::npos
+        && dict.compare(dict.find_first_not_of(": ", order + 15), 4, "True") == 0;
+
+    const size_t shape = dict.find("'shape'");
+    const size_t open = dict.find('(', shape);
+    const size_t close = dict.find(')', open);
+    if (shape == std::string::npos || open == std::string::npos
+        || close == std::string::npos) {
+        throw std::runtime_error(fname + ": missing array shape");
+    }
+    std::stringstream values(dict.substr(open + 1, close - open - 1));
+    std::string item;
+    int d = 0;
+    for (; std::getline(values, item, ','); ++d) {
+        if (item.find_first_not_of(' ') == std::string::npos) {
+            break;
+        }
+        if (d < 4) {
+            header.dims[d] = std::stoi(item);
+        }
+    }
+    if (d != 4) {
+        throw std::runtime_error(fname + ": expected an array shaped (x, y, z, sh)");
+    }
+
+    // C order has the last axis fastest, Fortran order the first
+    for (int i = 0; i < 4; ++i) {
+        header.stride_order[i] = fortran_order ? i : 3 - i;
+    }
+    return header;
+}
+
+NrrdHeader read_sh_header(const std::string &fname, SHBasis npy_basis)
+{
+    if (ends_with(fname, ".mif")) {
+        return read_mif_header(fname);
+    }
+    if (ends_with(fname, ".npy")) {
+        return read_npy_header(fname, npy_basis);
+    }
+    return read_nrrd_header(fname);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include "nrrd.h"
+
+/* Where each of the 15 native coefficients comes from in a voxel record of
+ * n_coeffs coefficients in the given basis, and the sign to apply. Sources
+ * past the end of the record are -1 and read as 0, so volumes with lmax = 2
+ * are padded. All supported bases are orthonormal, so converting only
+ * swaps the sine and cosine terms of each order and flips signs.
+ */
+void sh_basis_conversion(SHBasis basis,
+                         int n_coeffs,
+                         int source[SHCoeffView::coeff_count],
+                         float sign[SHCoeffView::coeff_count]);
+
+/* Read the header of an MRtrix image (.mif) holding a 4D SH volume of
+ * little-endian floats, in the MRtrix3 basis.
+ */
+NrrdHeader read_mif_header(const std::string &fname);
+
+/* Read the header of a NumPy array (.npy) of little-endian floats shaped
+ * (x, y, z, coefficients), as written by DIPY, in either memory order.
+ */
+NrrdHeader read_npy_header(const std::string &fname, SHBasis basis);
+
+// Read the header of any supported SH volume, picked by file extension
+NrrdHeader read_sh_header(const std::string &fname, SHBasis npy_basis = SHBasis::Descoteaux07);
@@ -0,0 +1,177 @@
+#include "sh_synth.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_group.h>
+#include "nrrd.h"
+
+// Voxels generated per chunk before it is written out
+const static size_t synth_chunk_voxels = 1024 * 1024;
+
+struct Dir {
+    float x, y, z;
+};
+
+static Dir normalized(float x, float y, float z)
+{
+    const float len = std::sqrt(x * x + y * y + z * z);
+    return Dir{x / len, y / len, z / len};
+}
+
+/* The 15 native SH basis functions at the unit vector d, following the
+ * definitions in module/sh.ih
+ */
+static void eval_sh_basis(const Dir &d, float out[SHCoeffView::coeff_count])
+{
+    const float x = d.x, y = d.y, z = d.z;
+    const float z_2 = z * z;
+    const float r_2 = x * x + y * y;
+    const float legendre_4_0 = z_2 * (z_2 - 3.0f * r_2) + 3.0f / 8.0f * r_2 * r_2;
+    const float scaled_legendre_4_1 = 2.67618617422915667f * z * (-z_2 + 0.75f * r_2);
+    const float scaled_legendre_4_2 = 2.83852408727268005f * (z_2 - (1.0f / 6.0f) * r_2);
+    const float cosine_2 = r_2 - 2.0f * y * y;
+    const float sine_2 = 2.0f * x * y;
+    const float cosine_3 = x * cosine_2 - y * sine_2;
+    const float sine_3 = x * sine_2 + y * cosine_2;
+    const float cosine_4 = x * cosine_3 - y * sine_3;
+    const float sine_4 = x * sine_3 + y * cosine_3;
+    out[0] = 0.282094791773878143f;
+    out[1] = 0.546274215296039535f * cosine_2;
+    out[2] = 1.09254843059207907f * x * z;
+    out[3] = 0.630783130505040012f * (z_2 - 0.5f * r_2);
+    out[4] = -1.09254843059207907f * y * z;
+    out[5] = 0.546274215296039535f * sine_2;
+    out[6] = 0.625835735449176135f * cosine_4;
+    out[7] = 1.77013076977993053f * cosine_3 * z;
+    out[8] = cosine_2 * scaled_legendre_4_2;
+    out[9] = -x * scaled_legendre_4_1;
+    out[10] = 0.846284375321634430f * legendre_4_0;
+    out[11] = y * scaled_legendre_4_1;
+    out[12] = sine_2 * scaled_legendre_4_2;
+    out[13] = -1.77013076977993053f * sine_3 * z;
+    out[14] = 0.625835735449176135f * sine_4;
+}
+
+/* Add weight times the ODF of a fiber along dir. The ODF is axially
+ * symmetric, so by the addition theorem its coefficients are the basis
+ * evaluated along the fiber, scaled per band by the heat kernel
+ * exp(-l(l + 1) blur).
+ */
+static void add_fiber(const Dir &dir, float weight, float blur, float *coeffs)
+{
+    float basis[SHCoeffView::coeff_count];
+    eval_sh_basis(dir, basis);
+    const float band_weight[3] = {
+        weight, weight * std::exp(-6.f * blur), weight * std::exp(-20.f * blur)};
+    for (int i = 0; i < SHCoeffView::coeff_count; ++i) {
+        const int band = i == 0 ? 0 : (i < 6 ? 1 : 2);
+        coeffs[i] += band_weight[band] * basis[i];
+    }
+}
+
+// SplitMix64, stateless so every voxel gets its own stream
+static uint64_t mix(uint64_t z)
+{
+    z += 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// Uniform in [-1, 1)
+static float uniform(uint64_t &state)
+{
+    state = mix(state);
+    return float(state >> 40) / float(1 << 23) - 1.f;
+}
+
+static void synth_voxel(const SyntheticSHParams &params, size_t voxel, float *coeffs)
+{
+    const int *dims = params.dims;
+    const size_t x = voxel % dims[0];
+    const size_t y = voxel / dims[0] % dims[1];
+    const size_t z = voxel / (size_t(dims[0]) * dims[1]);
+    // Position in [-0.5, 0.5]^3
+    const float p[3] = {(x + 0.5f) / dims[0] - 0.5f,
+                        (y + 0.5f) / dims[1] - 0.5f,
+                        (z + 0.5f) / dims[2] - 0.5f};
+    uint64_t rng = mix(params.seed ^ mix(voxel));
+
+    std::fill(coeffs, coeffs + SHCoeffView::coeff_count, 0.f);
+    const float brain = (p[0] * p[0] + p[1] * p[1]) / 0.2025f + p[2] * p[2] / 0.16f;
+    if (brain > 1.f) {
+        add_fiber(Dir{0.f, 0.f, 1.f}, 0.05f, 1e3f, coeffs);
+    } else {
+        // Bundle A follows circles around an axis off to the side in the xy
+        // plane, tilting up towards the top of the volume
+        const float cx = p[0] + 0.75f;
+        const float cy = p[1];
+        Dir a = normalized(-cy, cx, 0.3f * p[2]);
+        // Bundle B runs along z through a slab in x holding the crossings
+        const bool crossing = std::abs(p[0]) < 0.5f * params.crossing_fraction;
+        const float jitter = 0.1f * uniform(rng);
+        if (crossing) {
+            Dir b = normalized(0.15f * p[1], 0.1f * uniform(rng), 1.f);
+            add_fiber(a, 0.5f + jitter, params.blur, coeffs);
+            add_fiber(b, 0.5f - jitter, params.blur, coeffs);
+        } else {
+            add_fiber(a, 1.f + jitter, params.blur, coeffs);
+        }
+    }
+
+    const float noise = params.noise * coeffs[0];
+    for (int i = 0; i < SHCoeffView::coeff_count; ++i) {
+        coeffs[i] += noise * uniform(rng);
+    }
+}
+
+void write_synthetic_sh_volume(const std::string &fname, const SyntheticSHParams &params)
+{
+    const size_t coeff_count = SHCoeffView::coeff_count;
+    const size_t n_voxels = size_t(params.dims[0]) * params.dims[1] * params.dims[2];
+
+    std::ofstream out(fname, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error("Failed to open file: " + fname);
+    }
+    out << "NRRD0004\n"
+        << "# synthetic SH field, seed " << params.seed << "\n"
+        << "type: float\n"
+        << "dim: " << params.dims[0] << "," << params.dims[1] << "," << params.dims[2] << ","
+        << coeff_count << "\n"
+        << "layout: +1,+2,+3,+0\n"
+        << "encoding: raw\n"
+        << "END\n"
+        << std::string(payload_padding, '\0');
+
+    // Generate one chunk in parallel while the previous one is written
+    std::vector<float> chunks[2];
+    chunks[0].resize(synth_chunk_voxels * coeff_count);
+    chunks[1].resize(synth_chunk_voxels * coeff_count);
+    tbb::task_group writer;
+    int current = 0;
+    for (size_t begin = 0; begin < n_voxels; begin += synth_chunk_voxels) {
+        const size_t n = std::min(synth_chunk_voxels, n_voxels - begin);
+        float *chunk = chunks[current].data();
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, n),
+                          [&](const tbb::blocked_range<size_t> &r) {
+                              for (size_t i = r.begin(); i < r.end(); ++i) {
+                                  synth_voxel(params, begin + i, chunk + i * coeff_count);
+                              }
+                          });
+        // The write still running reads the other buffer
+        writer.wait();
+        writer.run([&out, chunk, n]() {
+            out.write(reinterpret_cast<const char *>(chunk), n * coeff_count * sizeof(float));
+        });
+        current = 1 - current;
+    }
+    writer.wait();
+    if (!out.good()) {
+        throw std::runtime_error("Failed to write synthetic volume: " + fname);
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/* A synthetic fiber field: a curved bundle filling an ellipsoidal "brain",
+ * crossed by a straight bundle along z in a slab through the middle, and
+ * low-signal isotropic background outside. Every voxel is computed from
+ * its position and the seed alone, so the output does not depend on thread
+ * count or scheduling.
+ */
+struct SyntheticSHParams {
+    int dims[3] = {64, 64, 64};
+    uint64_t seed = 1;
+    // Share of the fiber voxels in the slab where the bundles cross
+    float crossing_fraction = 0.3f;
+    // Per-coefficient noise relative to the l = 0 coefficient
+    float noise = 0.02f;
+    // Angular blur of the fiber ODFs, smaller is sharper
+    float blur = 0.05f;
+};
+
+/* Generate the field in parallel and stream it to fname as a raw glyph-major
+ * SH volume in the native basis, a chunk of voxels at a time, so the grid
+ * size is only limited by the disk.
+ */
+void write_synthetic_sh_volume(const std::string &fname, const SyntheticSHParams &params);
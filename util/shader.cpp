@@ -76,6 +76,12 @@ void Shader::uniform<float>(const std::string &unif, const float &t)
     glUniform1f(uniforms[unif], t);
 }
 
+template <>
+void Shader::uniform<glm::vec2>(const std::string &unif, const glm::vec2 &t)
+{
+    glUniform2f(uniforms[unif], t.x, t.y);
+}
+
 void Shader::parse_uniforms(const std::string &src)
 {
     const std::regex regex_unif("uniform[^;]+[ ](\\w+);");
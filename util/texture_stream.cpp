@@ -0,0 +1,93 @@
+#include "texture_stream.h"
+
+TextureStream::TextureStream(int width, int height)
+{
+    resize(width, height);
+}
+
+TextureStream::~TextureStream()
+{
+    release();
+    // Deleting a mapped buffer unmaps it
+    if (!pbos.empty()) {
+        glDeleteBuffers(pbos.size(), pbos.data());
+    }
+}
+
+void TextureStream::resize(int w, int h)
+{
+    release();
+    width = w;
+    height = h;
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(
+        GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void TextureStream::map(MappedPixels &pixels, size_t n_pixels)
+{
+    if (!pixels.pbo) {
+        glGenBuffers(1, &pixels.pbo);
+        pbos.push_back(pixels.pbo);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixels.pbo);
+    if (pixels.data) {
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        pixels.data = nullptr;
+    }
+    if (pixels.capacity < n_pixels) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, n_pixels * 4, nullptr, GL_STREAM_DRAW);
+        pixels.capacity = n_pixels;
+    }
+    // Invalidating lets the driver hand out fresh storage rather than wait
+    // for a texture update still reading the old contents
+    pixels.data = static_cast<uint32_t *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
+                                                           0,
+                                                           pixels.capacity * 4,
+                                                           GL_MAP_WRITE_BIT
+                                                               | GL_MAP_INVALIDATE_BUFFER_BIT));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureStream::upload(MappedPixels &pixels)
+{
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixels.pbo);
+    // A buffer whose storage was lost while mapped is left out
+    const bool intact = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+    pixels.data = nullptr;
+    if (intact) {
+        // Sourced from the bound buffer, so this returns before the copy
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexSubImage2D(
+            GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureStream::upload(const uint32_t *img)
+{
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, img);
+}
+
+std::vector<uint32_t> TextureStream::read() const
+{
+    std::vector<uint32_t> img(size_t(width) * height);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, img.data());
+    return img;
+}
+
+void TextureStream::release()
+{
+    if (texture) {
+        glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "glad/glad.h"
+
+/* A pixel unpack buffer mapped by the GL thread, so another thread can write
+ * a frame straight into it. Its storage belongs to the TextureStream that
+ * mapped it.
+ */
+struct MappedPixels {
+    GLuint pbo = 0;
+    // Null while the buffer is not mapped
+    uint32_t *data = nullptr;
+    // Pixels the buffer has room for
+    size_t capacity = 0;
+};
+
+/* Streams RGBA8 frames into a texture through pixel buffer objects. Each
+ * frame slot handed to the render thread carries its own mapped buffer, so
+ * the frame is copied once, from the OSPRay framebuffer into the buffer.
+ * The texture is updated from the buffer of the last finished frame, which
+ * the driver does asynchronously, while the render thread fills the next
+ * slot's buffer.
+ */
+struct TextureStream {
+    GLuint texture = 0;
+    int width = 0;
+    int height = 0;
+
+    TextureStream(int width, int height);
+
+    ~TextureStream();
+
+    TextureStream(const TextureStream &) = delete;
+    TextureStream &operator=(const TextureStream &) = delete;
+
+    // Reallocate the texture for a new frame size
+    void resize(int width, int height);
+
+    // Map the buffer, creating or growing it to hold n_pixels first, for a
+    // frame to be written into
+    void map(MappedPixels &pixels, size_t n_pixels);
+
+    // Unmap the buffer and update the texture from the width x height frame
+    // in it
+    void upload(MappedPixels &pixels);
+
+    // Update the texture from a frame in client memory, waiting on the copy
+    void upload(const uint32_t *img);
+
+    // The frame in the texture, for screenshots
+    std::vector<uint32_t> read() const;
+
+private:
+    // Every buffer handed out, deleted with the stream
+    std::vector<GLuint> pbos;
+
+    void release();
+};
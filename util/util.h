@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <vector>
 #include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 #include <tbb/parallel_reduce.h>
 #include <glm/glm.hpp>
 
@@ -16,6 +19,12 @@ std::string get_file_basepath(const std::string &path);
 
 bool starts_with(const std::string &str, const std::string &prefix);
 
+// Peak resident set size of the process so far, in bytes
+size_t peak_rss_bytes();
+
+// CPU time used by all threads of the process so far, in seconds
+double process_cpu_seconds();
+
 template <typename T>
 glm::vec2 compute_value_range(const T *vals, size_t n_vals)
 {
@@ -39,3 +48,41 @@ glm::vec2 compute_value_range(const T *vals, size_t n_vals)
         [](const T &a, const T &b) { return std::max(a, b); });
     return glm::vec2(min_val, max_val);
 }
+
+/* The indices in [0, n) for which keep(i) is true, in order. Compacted in
+ * parallel: each block evaluates keep once per index into a byte flag and
+ * counts what it keeps, an exclusive prefix sum over the counts gives every
+ * block its output offset, then the blocks write their flagged indices there.
+ */
+template <typename F>
+std::vector<size_t> compact_indices(size_t n, const F &keep)
+{
+    const size_t block_size = 64 * 1024;
+    const size_t n_blocks = (n + block_size - 1) / block_size;
+    std::vector<size_t> offsets(n_blocks + 1, 0);
+    std::vector<uint8_t> flags(n);
+    tbb::parallel_for(size_t(0), n_blocks, [&](size_t b) {
+        const size_t end = std::min(n, (b + 1) * block_size);
+        size_t kept = 0;
+        for (size_t i = b * block_size; i < end; ++i) {
+            flags[i] = keep(i) ? 1 : 0;
+            kept += flags[i];
+        }
+        offsets[b + 1] = kept;
+    });
+    for (size_t b = 0; b < n_blocks; ++b) {
+        offsets[b + 1] += offsets[b];
+    }
+
+    std::vector<size_t> indices(offsets[n_blocks]);
+    tbb::parallel_for(size_t(0), n_blocks, [&](size_t b) {
+        const size_t end = std::min(n, (b + 1) * block_size);
+        size_t out = offsets[b];
+        for (size_t i = b * block_size; i < end; ++i) {
+            if (flags[i]) {
+                indices[out++] = i;
+            }
+        }
+    });
+    return indices;
+}